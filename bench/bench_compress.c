@@ -0,0 +1,115 @@
+// Measures the CPU cost per input byte and the ratio of every compression level on generated JSON payloads
+// The numbers are meant for picking compressLevel, compressLargeLevel and compressLargeSize
+// Usage: bench_compress [megabytes compressed per measurement]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <zlib.h>
+#include "compression.h"
+
+#define DEFAULT_MEGABYTES 32
+
+static const size_t payload_sizes[] = { 1024, 16 * 1024, 256 * 1024, 4 * 1024 * 1024 };
+
+#define PAYLOAD_COUNT (sizeof(payload_sizes) / sizeof(payload_sizes[0]))
+
+static double cpu_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Fills payload with NDJSON telemetry records like the ones posted to /ingest
+static void generate(char *payload, const size_t size) {
+    static const char *sensors[] = { "boiler", "intake", "exhaust", "pump-a", "pump-b" };
+    size_t len = 0;
+
+    for (int i = 0; len < size; i++) {
+        char record[160];
+        const int recordLen = snprintf(record, sizeof(record),
+                                       "{\"id\": %d, \"sensor\": \"%s\", \"value\": %.3f, \"ok\": %s, \"ts\": %d}\n",
+                                       i, sensors[rand() % 5], (rand() % 2000000 - 1000000) / 1000.0,
+                                       rand() % 10 ? "true" : "false", 1700000000 + i * 5);
+        const size_t n = len + recordLen <= size ? (size_t)recordLen : size - len;
+        memcpy(payload + len, record, n);
+        len += n;
+    }
+}
+
+// Counts the bytes the server would write to the socket
+static bool count_output(void *ctx, const char *data, const size_t len) {
+    (void)data;
+    *(size_t *)ctx += len;
+    return true;
+}
+
+// Decompresses with the format detected from the header and compares against the original
+static bool round_trips(const char *compressed, const size_t compressedLen, const char *payload, const size_t size) {
+    char *out = malloc(size + 1);
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+
+    // 32 more window bits accepts both the gzip and the zlib wrapper
+    if (out == NULL || inflateInit2(&stream, 15 + 32) != Z_OK) {
+        free(out);
+        return false;
+    }
+    stream.next_in = (Bytef *)compressed;
+    stream.avail_in = compressedLen;
+    stream.next_out = (Bytef *)out;
+    stream.avail_out = size + 1;
+    const bool ok = inflate(&stream, Z_FINISH) == Z_STREAM_END && stream.total_out == size &&
+                    memcmp(out, payload, size) == 0;
+    inflateEnd(&stream);
+    free(out);
+    return ok;
+}
+
+static void bench_level(const char *payload, const size_t size, const content_encoding encoding, const int level,
+                        const size_t budget) {
+    const int iterations = budget / size > 3 ? (int)(budget / size) : 3;
+    size_t compressedLen = 0;
+
+    const double start = cpu_seconds();
+    for (int i = 0; i < iterations; i++) {
+        compressedLen = 0;
+        compressStream(encoding, level, payload, size, count_output, &compressedLen);
+    }
+    const double elapsed = cpu_seconds() - start;
+
+    char *compressed = NULL;
+    size_t len;
+    const bool ok = compressToBuffer(encoding, level, payload, size, &compressed, &len) &&
+                    round_trips(compressed, len, payload, size);
+    free(compressed);
+    printf("%-8s %8zu  level %d  %7.2f ns/byte  %8.1f MB/s  ratio %5.2f%s\n",
+           encodingName(encoding), size, level, elapsed * 1e9 / ((double)size * iterations),
+           (double)size * iterations / elapsed / 1e6, (double)size / compressedLen, ok ? "" : "  ROUND TRIP FAILED");
+}
+
+int main(int argc, char **argv) {
+    const int megabytes = argc > 1 ? atoi(argv[1]) : DEFAULT_MEGABYTES;
+    const size_t largest = payload_sizes[PAYLOAD_COUNT - 1];
+    char *payload = malloc(largest);
+
+    if (megabytes <= 0 || payload == NULL) {
+        printf("Usage: %s [megabytes compressed per measurement]\n", argv[0]);
+        return 1;
+    }
+    srand(42);
+    printf("%d MB compressed per measurement, CPU time of the streaming path\n", megabytes);
+
+    for (size_t i = 0; i < PAYLOAD_COUNT; i++) {
+        generate(payload, payload_sizes[i]);
+
+        for (int level = 1; level <= 9; level++) {
+            bench_level(payload, payload_sizes[i], ENCODING_GZIP, level, (size_t)megabytes * 1024 * 1024);
+        }
+        // The zlib wrapper only differs from gzip in its header and checksum, one level is enough to see it
+        bench_level(payload, payload_sizes[i], ENCODING_DEFLATE, 6, (size_t)megabytes * 1024 * 1024);
+    }
+    free(payload);
+    return 0;
+}
@@ -0,0 +1,158 @@
+// Compares parseDouble()/parseInt64() against strtod()/strtoll() on generated datasets
+// Usage: bench_numparse [count]
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "numparse.h"
+
+#define DEFAULT_COUNT 1000000
+#define NUMBER_SIZE 32
+
+typedef enum { DATASET_TELEMETRY, DATASET_INTEGERS, DATASET_EXPONENTS } Dataset;
+
+static const char *dataset_names[] = { "telemetry", "integers", "exponents" };
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t double_bits(const double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static uint64_t random_u64() {
+    return ((uint64_t)rand() << 62) ^ ((uint64_t)rand() << 31) ^ (uint64_t)rand();
+}
+
+// Fills numbers with count NUL-terminated strings of NUMBER_SIZE bytes each
+static void generate(char *numbers, const int count, const Dataset dataset) {
+    for (int i = 0; i < count; i++) {
+        char *out = numbers + (size_t)i * NUMBER_SIZE;
+
+        switch (dataset) {
+            case DATASET_TELEMETRY:
+                // Sensor style values: a few integer digits and a fixed number of decimals
+                snprintf(out, NUMBER_SIZE, "%.3f", (double)(rand() % 2000000 - 1000000) / 1000.0);
+                break;
+            case DATASET_INTEGERS:
+                snprintf(out, NUMBER_SIZE, "%" PRId64, (int64_t)random_u64());
+                break;
+            case DATASET_EXPONENTS: {
+                double value;
+                do {
+                    uint64_t bits = random_u64();
+                    memcpy(&value, &bits, sizeof(value));
+                } while (value != value || value - value != 0);   // Skip NaN and infinities
+                snprintf(out, NUMBER_SIZE, "%.17g", value);
+                break;
+            }
+        }
+    }
+}
+
+static void bench_doubles(const char *numbers, const int count, const Dataset dataset) {
+    size_t bytes = 0;
+    int mismatches = 0;
+    // XOR of the result bits, a sum overflows to inf and then NaN on the exponents dataset
+    uint64_t checksum_fast = 0, checksum_ref = 0;
+
+    for (int i = 0; i < count; i++) {
+        bytes += strlen(numbers + (size_t)i * NUMBER_SIZE);
+    }
+
+    double start = now_seconds();
+    for (int i = 0; i < count; i++) {
+        const char *number = numbers + (size_t)i * NUMBER_SIZE;
+        double value = 0;
+        parseDouble(number, strlen(number), &value);
+        checksum_fast ^= double_bits(value);
+    }
+    const double fast = now_seconds() - start;
+
+    start = now_seconds();
+    for (int i = 0; i < count; i++) {
+        checksum_ref ^= double_bits(strtod(numbers + (size_t)i * NUMBER_SIZE, NULL));
+    }
+    const double ref = now_seconds() - start;
+
+    // Every result must match strtod() bit for bit
+    for (int i = 0; i < count; i++) {
+        const char *number = numbers + (size_t)i * NUMBER_SIZE;
+        double value = 0;
+        const double expected = strtod(number, NULL);
+
+        if (!parseDouble(number, strlen(number), &value) || memcmp(&value, &expected, sizeof(value)) != 0) {
+            if (mismatches++ < 5) {
+                printf("  mismatch: %s -> %.17g (strtod %.17g)\n", number, value, expected);
+            }
+        }
+    }
+
+    printf("%-10s parseDouble %7.2f ns/num %8.1f MB/s | strtod %7.2f ns/num %8.1f MB/s | x%.2f | mismatches %d (checksum diff %016" PRIx64 ")\n",
+           dataset_names[dataset],
+           fast * 1e9 / count, bytes / fast / 1e6,
+           ref * 1e9 / count, bytes / ref / 1e6,
+           ref / fast, mismatches, checksum_fast ^ checksum_ref);
+}
+
+static void bench_integers(const char *numbers, const int count) {
+    uint64_t checksum_fast = 0, checksum_ref = 0;
+    int mismatches = 0;
+
+    double start = now_seconds();
+    for (int i = 0; i < count; i++) {
+        const char *number = numbers + (size_t)i * NUMBER_SIZE;
+        int64_t value = 0;
+        parseInt64(number, strlen(number), &value);
+        checksum_fast ^= (uint64_t)value;
+    }
+    const double fast = now_seconds() - start;
+
+    start = now_seconds();
+    for (int i = 0; i < count; i++) {
+        checksum_ref ^= (uint64_t)strtoll(numbers + (size_t)i * NUMBER_SIZE, NULL, 10);
+    }
+    const double ref = now_seconds() - start;
+
+    for (int i = 0; i < count; i++) {
+        const char *number = numbers + (size_t)i * NUMBER_SIZE;
+        int64_t value = 0;
+
+        if (!parseInt64(number, strlen(number), &value) || value != strtoll(number, NULL, 10)) {
+            mismatches++;
+        }
+    }
+
+    printf("%-10s parseInt64  %7.2f ns/num | strtoll %7.2f ns/num | x%.2f | mismatches %d (checksum diff %016" PRIx64 ")\n",
+           dataset_names[DATASET_INTEGERS], fast * 1e9 / count, ref * 1e9 / count, ref / fast,
+           mismatches, checksum_fast ^ checksum_ref);
+}
+
+int main(int argc, char **argv) {
+    const int count = argc > 1 ? atoi(argv[1]) : DEFAULT_COUNT;
+    char *numbers = malloc((size_t)count * NUMBER_SIZE);
+
+    if (count <= 0 || numbers == NULL) {
+        printf("Usage: %s [count]\n", argv[0]);
+        return 1;
+    }
+    srand(42);
+
+    for (int dataset = DATASET_TELEMETRY; dataset <= DATASET_EXPONENTS; dataset++) {
+        generate(numbers, count, dataset);
+        bench_doubles(numbers, count, dataset);
+
+        if (dataset == DATASET_INTEGERS) {
+            bench_integers(numbers, count);
+        }
+    }
+    free(numbers);
+    return 0;
+}
@@ -0,0 +1,217 @@
+// Measures the effect of each socket option on the webserver over loopback
+// Every variant starts a fresh server with the option set and runs the same load against it
+// Usage: bench_sockopt [requests per variant] [clients] [webserver path]
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#define DEFAULT_REQUESTS 5000
+#define DEFAULT_CLIENTS 4
+#define BENCH_PORT 18080
+#define MAX_VARIANT_ARGS 6
+
+#ifndef WEBSERVER_PATH
+#define WEBSERVER_PATH "./webserver"
+#endif
+
+typedef struct variant {
+    const char *name;
+    const char *args[MAX_VARIANT_ARGS];
+    bool clientFastOpen;    // Clients use TCP_FASTOPEN_CONNECT so the request rides in the SYN
+} variant;
+
+static const variant variants[] = {
+    { "baseline",          { NULL }, false },
+    { "tcp-nodelay",       { "--tcp-nodelay", "1", NULL }, false },
+    { "tcp-cork",          { "--tcp-cork", "1", NULL }, false },
+    { "nodelay+cork",      { "--tcp-nodelay", "1", "--tcp-cork", "1", NULL }, false },
+    { "defer-accept",      { "--defer-accept", "1", NULL }, false },
+    { "fast-open",         { "--fast-open", "256", NULL }, true },
+    { "buffers-256k",      { "--rcvbuf", "262144", "--sndbuf", "262144", NULL }, false },
+    { "buffers-16k",       { "--rcvbuf", "16384", "--sndbuf", "16384", NULL }, false },
+    { "busy-poll-50us",    { "--busy-poll", "50", NULL }, false },
+};
+
+#define VARIANT_COUNT (sizeof(variants) / sizeof(variants[0]))
+
+static const char request[] = "POST /bench HTTP/1.1\r\n"
+                              "Host: localhost\r\n"
+                              "Content-Type: application/json\r\n"
+                              "Content-Length: 47\r\n\r\n"
+                              "{\"sensor\": \"a1\", \"value\": 21.5, \"ok\": true}\r\n\r\n";
+
+typedef struct client {
+    const variant *variant;
+    int requests;
+    double *latencies;
+    int completed;
+    int failed;
+    pthread_t thread;
+} client;
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    const double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static bool run_request(const bool fastOpen) {
+    const int socketFeed = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (socketFeed < 0) {
+        return false;
+    }
+    if (fastOpen) {
+        const int opt = 1;
+        setsockopt(socketFeed, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &opt, sizeof(opt));
+    }
+
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(BENCH_PORT) };
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bool ok = connect(socketFeed, (struct sockaddr *)&addr, sizeof(addr)) == 0 &&
+              write(socketFeed, request, strlen(request)) == (ssize_t)strlen(request);
+
+    // The server answers and closes the connection
+    char response[1024];
+    ssize_t valread;
+    bool gotResponse = false;
+
+    while (ok && (valread = read(socketFeed, response, sizeof(response))) > 0) {
+        gotResponse = true;
+    }
+    close(socketFeed);
+    return ok && gotResponse;
+}
+
+static void* run_client(void *arg) {
+    client *c = arg;
+
+    for (int i = 0; i < c->requests; i++) {
+        const double start = now_seconds();
+
+        if (run_request(c->variant->clientFastOpen)) {
+            c->latencies[c->completed++] = now_seconds() - start;
+        } else {
+            c->failed++;
+        }
+    }
+    return NULL;
+}
+
+static pid_t start_server(const char *path, const variant *v) {
+    char port[32];
+    snprintf(port, sizeof(port), "127.0.0.1:%d", BENCH_PORT);
+    const char *argv[8 + MAX_VARIANT_ARGS] = { path, "--listen", port, "--table-capacity", "64" };
+    int argc = 5;
+
+    for (int i = 0; i < MAX_VARIANT_ARGS && v->args[i] != NULL; i++) {
+        argv[argc++] = v->args[i];
+    }
+    argv[argc] = NULL;
+
+    // Otherwise the child flushes our pending report lines a second time
+    fflush(stdout);
+    const pid_t pid = fork();
+
+    if (pid == 0) {
+        // The server logs every request, keep it out of the report
+        if (freopen("/dev/null", "w", stdout) == NULL) {
+            _exit(1);
+        }
+        execv(path, (char **)argv);
+        perror("bench (execv)");
+        _exit(1);
+    }
+
+    // Wait until the server accepts connections
+    for (int attempt = 0; pid > 0 && attempt < 200; attempt++) {
+        if (run_request(false)) {
+            return pid;
+        }
+        usleep(10000);
+    }
+    printf("%-16s server did not start\n", v->name);
+    if (pid > 0) {
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+    }
+    return -1;
+}
+
+static void run_variant(const char *path, const variant *v, const int requests, const int clients) {
+    const pid_t pid = start_server(path, v);
+
+    if (pid < 0) {
+        return;
+    }
+
+    client *pool = calloc(clients, sizeof(client));
+    double *latencies = malloc(sizeof(double) * requests);
+    int completed = 0, failed = 0;
+
+    const double start = now_seconds();
+    for (int i = 0; i < clients; i++) {
+        pool[i].variant = v;
+        pool[i].requests = requests / clients;
+        pool[i].latencies = malloc(sizeof(double) * pool[i].requests);
+        pthread_create(&pool[i].thread, NULL, run_client, &pool[i]);
+    }
+    for (int i = 0; i < clients; i++) {
+        pthread_join(pool[i].thread, NULL);
+        memcpy(latencies + completed, pool[i].latencies, sizeof(double) * pool[i].completed);
+        completed += pool[i].completed;
+        failed += pool[i].failed;
+        free(pool[i].latencies);
+    }
+    const double elapsed = now_seconds() - start;
+
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+
+    if (completed > 0) {
+        qsort(latencies, completed, sizeof(double), compare_doubles);
+        printf("%-16s %9.0f req/s  p50 %7.1f us  p99 %7.1f us  max %8.1f us  failed %d\n",
+               v->name, completed / elapsed,
+               latencies[completed / 2] * 1e6,
+               latencies[(int)(completed * 0.99)] * 1e6,
+               latencies[completed - 1] * 1e6, failed);
+    } else {
+        printf("%-16s no request completed, failed %d\n", v->name, failed);
+    }
+    free(latencies);
+    free(pool);
+}
+
+int main(int argc, char **argv) {
+    const int requests = argc > 1 ? atoi(argv[1]) : DEFAULT_REQUESTS;
+    const int clients = argc > 2 ? atoi(argv[2]) : DEFAULT_CLIENTS;
+    const char *path = argc > 3 ? argv[3] : WEBSERVER_PATH;
+
+    if (requests <= 0 || clients <= 0 || clients > requests) {
+        printf("Usage: %s [requests per variant] [clients] [webserver path]\n", argv[0]);
+        return 1;
+    }
+    printf("%d requests per variant, %d clients, server %s\n", requests, clients, path);
+
+    for (size_t i = 0; i < VARIANT_COUNT; i++) {
+        run_variant(path, &variants[i], requests, clients);
+    }
+    return 0;
+}
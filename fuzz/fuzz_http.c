@@ -0,0 +1,43 @@
+// Fuzz target for parseRequestHead(), findHeader() and the Accept-Encoding negotiation
+// Inputs are raw request heads as read from a socket, optionally followed by a body
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "compression.h"
+#include "http.h"
+
+// Headers the server looks up while serving a request
+static const char *headers[] = { "Content-Length: ", "Transfer-Encoding: ", "Accept-Encoding: " };
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, const size_t size) {
+    // serveRequest() terminates what it read before parsing it
+    char *buffer = malloc(size + 1);
+
+    if (buffer == NULL) {
+        return 0;
+    }
+    memcpy(buffer, data, size);
+    buffer[size] = '\0';
+
+    http_request request;
+
+    if (parseRequestHead(buffer, &request)) {
+        // The head must lie inside what was read and the request line must be terminated
+        if (request.headersLen > (int)strlen(buffer) || strlen(request.method) >= MAX_METHOD_SIZE ||
+            strlen(request.uri) >= MAX_URI_SIZE || strlen(request.version) >= MAX_VERSION_SIZE) {
+            abort();
+        }
+
+        for (size_t i = 0; i < sizeof(headers) / sizeof(headers[0]); i++) {
+            const char *value = findHeader(buffer, request.headerEnd, headers[i]);
+
+            if (value != NULL && value > request.headerEnd) {
+                abort();
+            }
+        }
+        negotiateEncoding(findHeader(buffer, request.headerEnd, "Accept-Encoding: "));
+    }
+    free(buffer);
+    return 0;
+}
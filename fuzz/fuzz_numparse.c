@@ -0,0 +1,95 @@
+// Differential fuzz target for the fast number parsers
+// Every input scanNumber() accepts as a whole must give the same value from parseDouble()/parseInt64()
+// as from strtod()/strtoll(), bit for bit. The first disagreement aborts with both results
+// The time spent on each side is printed at exit so the runs double as a throughput comparison
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "numparse.h"
+
+// Longer inputs aren't numbers anyone sends, they only slow the fuzzer down
+#define MAX_NUMBER_SIZE 128
+
+static size_t numbers, bytes;
+static double fastSeconds, referenceSeconds;
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report() {
+    if (numbers == 0) {
+        return;
+    }
+    fprintf(stderr, "numparse: %zu numbers, %zu bytes, fast %.1f MB/s, reference %.1f MB/s\n", numbers, bytes,
+            fastSeconds > 0 ? bytes / fastSeconds / 1e6 : 0, referenceSeconds > 0 ? bytes / referenceSeconds / 1e6 : 0);
+}
+
+int LLVMFuzzerInitialize(int *argc, char ***argv) {
+    (void)argc;
+    (void)argv;
+    atexit(report);
+    return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, const size_t size) {
+    if (size == 0 || size > MAX_NUMBER_SIZE) {
+        return 0;
+    }
+    char text[MAX_NUMBER_SIZE + 1];
+    memcpy(text, data, size);
+    text[size] = '\0';
+
+    ValueType type;
+    const double fastStart = now_seconds();
+    const size_t scanned = scanNumber(text, size, &type);
+
+    if (scanned > size) {
+        fprintf(stderr, "scanNumber() consumed %zu of %zu bytes\n", scanned, size);
+        abort();
+    }
+    if (scanned != size) {
+        return 0;
+    }
+    double fast = 0;
+    int64_t fastInt = 0;
+    const bool fastOk = parseDouble(text, size, &fast);
+    const bool fastIntOk = type == INT && parseInt64(text, size, &fastInt);
+    const double referenceStart = now_seconds();
+
+    char *end;
+    const double reference = strtod(text, &end);
+    long long referenceInt = 0;
+    bool referenceIntRange = false;
+
+    if (type == INT) {
+        errno = 0;
+        referenceInt = strtoll(text, NULL, 10);
+        referenceIntRange = errno == ERANGE;
+    }
+    const double referenceEnd = now_seconds();
+
+    fastSeconds += referenceStart - fastStart;
+    referenceSeconds += referenceEnd - referenceStart;
+    numbers++;
+    bytes += size;
+
+    if (!fastOk || end != text + size || memcmp(&fast, &reference, sizeof(double)) != 0) {
+        fprintf(stderr, "parseDouble(\"%s\") = %.17g (ok %d), strtod() = %.17g\n", text, fast, fastOk, reference);
+        abort();
+    }
+    // parseInt64() refuses exactly the integers strtoll() reports out of range
+    if (type == INT && (fastIntOk != !referenceIntRange || (fastIntOk && fastInt != referenceInt))) {
+        fprintf(stderr, "parseInt64(\"%s\") = %" PRId64 " (ok %d), strtoll() = %lld (ERANGE %d)\n",
+                text, fastInt, fastIntOk, referenceInt, referenceIntRange);
+        abort();
+    }
+    return 0;
+}
@@ -0,0 +1,136 @@
+// Runs a fuzz target without libFuzzer, on the files and directories given as arguments or on stdin
+// Built with afl-gcc or afl-clang-fast it is the AFL harness: afl-fuzz -i corpus/json -o findings -- ./fuzz_json @@
+// -runs=N replays the whole input set N times, the throughput is printed to stderr at the end
+
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+__attribute__((weak)) int LLVMFuzzerInitialize(int *argc, char ***argv);
+
+// Defines a struct for an input loaded in memory so the timing doesn't include the disk
+typedef struct fuzz_input {
+    uint8_t *data;
+    size_t size;
+} fuzz_input;
+
+static fuzz_input *inputs;
+static size_t inputCount, inputCapacity;
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void add_input(FILE *file, const char *name) {
+    size_t capacity = 4096, size = 0;
+    uint8_t *data = malloc(capacity);
+    size_t n;
+
+    while (data != NULL && (n = fread(data + size, 1, capacity - size, file)) > 0) {
+        size += n;
+
+        if (size == capacity) {
+            uint8_t *grown = realloc(data, capacity * 2);
+
+            if (grown == NULL) {
+                free(data);
+                data = NULL;
+                break;
+            }
+            data = grown;
+            capacity *= 2;
+        }
+    }
+    if (inputCount == inputCapacity) {
+        inputCapacity = inputCapacity > 0 ? inputCapacity * 2 : 64;
+        inputs = realloc(inputs, sizeof(fuzz_input) * inputCapacity);
+    }
+    if (data == NULL || inputs == NULL) {
+        fprintf(stderr, "Error loading %s\n", name);
+        exit(1);
+    }
+    inputs[inputCount].data = data;
+    inputs[inputCount].size = size;
+    inputCount++;
+}
+
+static void add_path(const char *path) {
+    struct stat st;
+
+    if (stat(path, &st) != 0) {
+        perror(path);
+        exit(1);
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+        DIR *dir = opendir(path);
+        const struct dirent *entry;
+
+        while (dir != NULL && (entry = readdir(dir)) != NULL) {
+            if (entry->d_name[0] != '.') {
+                char child[4096];
+                snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+                add_path(child);
+            }
+        }
+        if (dir != NULL) {
+            closedir(dir);
+        }
+        return;
+    }
+
+    FILE *file = fopen(path, "rb");
+
+    if (file == NULL) {
+        perror(path);
+        exit(1);
+    }
+    add_input(file, path);
+    fclose(file);
+}
+
+int main(int argc, char **argv) {
+    long runs = 1;
+
+    if (LLVMFuzzerInitialize != NULL) {
+        LLVMFuzzerInitialize(&argc, &argv);
+    }
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "-runs=", strlen("-runs=")) == 0) {
+            runs = strtol(argv[i] + strlen("-runs="), NULL, 10);
+        } else if (argv[i][0] != '-') {
+            add_path(argv[i]);
+        }
+    }
+    if (inputCount == 0) {
+        add_input(stdin, "stdin");
+    }
+
+    size_t bytes = 0;
+    const double start = now_seconds();
+
+    for (long run = 0; run < runs; run++) {
+        for (size_t i = 0; i < inputCount; i++) {
+            LLVMFuzzerTestOneInput(inputs[i].data, inputs[i].size);
+            bytes += inputs[i].size;
+        }
+    }
+    const double elapsed = now_seconds() - start;
+
+    fprintf(stderr, "%s: %zu inputs x %ld runs, %zu bytes in %.3f s, %.0f execs/s, %.1f MB/s\n", argv[0], inputCount,
+            runs, bytes, elapsed, elapsed > 0 ? inputCount * runs / elapsed : 0, elapsed > 0 ? bytes / elapsed / 1e6 : 0);
+
+    for (size_t i = 0; i < inputCount; i++) {
+        free(inputs[i].data);
+    }
+    free(inputs);
+    return 0;
+}
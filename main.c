@@ -1,7 +1,10 @@
 
 #include "src/network.h"
 
-int main() {
-    startWebserver();
+int main(int argc, char **argv) {
+    if (!initConfig(argc, argv)) {
+        return 1;
+    }
+    startWebserver(argv);
     return 0;
 }
\ No newline at end of file
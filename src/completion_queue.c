@@ -0,0 +1,104 @@
+#include "completion_queue.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+bool init_completion_queue(completion_queue *queue) {
+    queue->eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (queue->eventFd < 0) {
+        perror("webserver (eventfd)");
+        return false;
+    }
+    atomic_init(&queue->stub.next, NULL);
+    atomic_init(&queue->head, &queue->stub);
+    atomic_init(&queue->posting, 0);
+    queue->tail = &queue->stub;
+    return true;
+}
+
+static void push(completion_queue *queue, completion *done) {
+    atomic_store_explicit(&done->next, NULL, memory_order_relaxed);
+    completion *previous = atomic_exchange_explicit(&queue->head, done, memory_order_acq_rel);
+    // Until this store the owner sees the queue end at previous, it picks done up on the next wakeup
+    atomic_store_explicit(&previous->next, done, memory_order_release);
+}
+
+// Owner only: takes the oldest completion
+// Returns NULL if the queue is empty or a producer is halfway through posting
+static completion* pop(completion_queue *queue) {
+    completion *tail = queue->tail;
+    completion *next = atomic_load_explicit(&tail->next, memory_order_acquire);
+
+    if (tail == &queue->stub) {
+        if (next == NULL) {
+            return NULL;
+        }
+        queue->tail = next;
+        tail = next;
+        next = atomic_load_explicit(&next->next, memory_order_acquire);
+    }
+    if (next != NULL) {
+        queue->tail = next;
+        return tail;
+    }
+    if (tail != atomic_load_explicit(&queue->head, memory_order_acquire)) {
+        return NULL;
+    }
+
+    // tail is the last completion, put the stub behind it so it can be handed out
+    push(queue, &queue->stub);
+    next = atomic_load_explicit(&tail->next, memory_order_acquire);
+
+    if (next != NULL) {
+        queue->tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+// Posts a completion from any thread and wakes the owner
+// The owner can run done's callback as soon as it's pushed, so the queue must not go away before the write
+void completion_queue_post(completion_queue *queue, completion *done) {
+    atomic_fetch_add_explicit(&queue->posting, 1, memory_order_acq_rel);
+    push(queue, done);
+    const uint64_t one = 1;
+
+    if (write(queue->eventFd, &one, sizeof(one)) != sizeof(one)) {
+        perror("webserver (write eventfd)");
+    }
+    // Last touch of the queue, it can be closed and freed from here on
+    atomic_fetch_sub_explicit(&queue->posting, 1, memory_order_release);
+}
+
+// Owner only: runs the callback of every posted completion
+// Returns the number of completions run
+int completion_queue_drain(completion_queue *queue) {
+    // Reset the counter first so a completion posted while draining signals again
+    uint64_t signaled;
+
+    if (read(queue->eventFd, &signaled, sizeof(signaled)) < 0 && errno != EAGAIN) {
+        perror("webserver (read eventfd)");
+    }
+
+    int count = 0;
+    completion *done;
+
+    while ((done = pop(queue)) != NULL) {
+        done->callback(done);
+        count++;
+    }
+    return count;
+}
+
+// Waits for producers still writing the eventfd, the queue can be freed once this returns
+void close_completion_queue(completion_queue *queue) {
+    while (atomic_load_explicit(&queue->posting, memory_order_acquire) != 0) {
+        sched_yield();
+    }
+    close(queue->eventFd);
+}
@@ -0,0 +1,29 @@
+#ifndef COMPLETION_QUEUE_H
+#define COMPLETION_QUEUE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+// Defines a struct for finished work handed back to the thread that submitted it
+// Embedded as the first member of the job it completes so the callback can cast it back
+typedef struct completion {
+    _Atomic(struct completion *) next;
+    void (*callback)(struct completion *done);
+} completion;
+
+// Defines a struct for a lock-free multi-producer single-consumer queue of completions
+// Any thread can post, only the owning event loop drains it once its eventfd becomes readable
+typedef struct completion_queue {
+    _Atomic(completion *) head;     // Last posted, producers swap themselves in here
+    completion *tail;               // Next to run, only touched by the owner
+    completion stub;                // Keeps the queue non-empty so producers never touch tail
+    int eventFd;
+    atomic_int posting;             // Producers between their push and their eventfd write, closing waits for them
+} completion_queue;
+
+bool init_completion_queue(completion_queue *queue);
+void completion_queue_post(completion_queue *queue, completion *done);
+int completion_queue_drain(completion_queue *queue);
+void close_completion_queue(completion_queue *queue);
+
+#endif //COMPLETION_QUEUE_H
@@ -0,0 +1,286 @@
+#include "compression.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <zlib.h>
+
+// Compressed bytes handed to the sink at a time
+#define COMPRESS_CHUNK_SIZE (16 * 1024)
+// Input fed to zlib at a time, avail_in is only 32 bits
+#define COMPRESS_INPUT_SLICE (1024 * 1024)
+
+static bool is_coding_end(const char c) {
+    return c == '\0' || c == '\r' || c == '\n' || c == ',';
+}
+
+// Picks the encoding from the value of an Accept-Encoding header, preferring gzip when the client has no preference
+// Codings the client doesn't list (and doesn't cover with *) or lists with q=0 are never picked
+content_encoding negotiateEncoding(const char *acceptEncoding) {
+    if (acceptEncoding == NULL) {
+        return ENCODING_IDENTITY;
+    }
+    // -1 until the coding is listed
+    double gzip = -1, deflate = -1, wildcard = -1;
+    const char *c = acceptEncoding;
+
+    while (*c != '\0' && *c != '\r' && *c != '\n') {
+        while (*c == ' ' || *c == '\t' || *c == ',') {
+            c++;
+        }
+        const char *name = c;
+
+        while (!is_coding_end(*c) && *c != ';' && *c != ' ' && *c != '\t') {
+            c++;
+        }
+        const size_t nameLen = c - name;
+        double quality = 1;
+
+        // Parameters up to the next coding, only q matters
+        for (; !is_coding_end(*c); c++) {
+            if ((*c == 'q' || *c == 'Q') && c[1] == '=' && (c[-1] == ';' || c[-1] == ' ' || c[-1] == '\t')) {
+                quality = strtod(c + 2, NULL);
+            }
+        }
+
+        if ((nameLen == 4 && strncasecmp(name, "gzip", 4) == 0) || (nameLen == 6 && strncasecmp(name, "x-gzip", 6) == 0)) {
+            gzip = quality;
+        } else if (nameLen == 7 && strncasecmp(name, "deflate", 7) == 0) {
+            deflate = quality;
+        } else if (nameLen == 1 && *name == '*') {
+            wildcard = quality;
+        }
+    }
+
+    gzip = gzip < 0 ? wildcard : gzip;
+    deflate = deflate < 0 ? wildcard : deflate;
+
+    if (gzip > 0 && gzip >= deflate) {
+        return ENCODING_GZIP;
+    }
+    return deflate > 0 ? ENCODING_DEFLATE : ENCODING_IDENTITY;
+}
+
+// Returns the Content-Encoding token for encoding
+const char* encodingName(const content_encoding encoding) {
+    switch (encoding) {
+        case ENCODING_GZIP:
+            return "gzip";
+        case ENCODING_DEFLATE:
+            return "deflate";
+        default:
+            return "identity";
+    }
+}
+
+// Picks the level for a body of len bytes, 0 if it isn't worth compressing
+// Large bodies get the cheaper level since the CPU cost grows with the size
+int compressionLevel(const config *cfg, const size_t len) {
+    if (cfg->compressLevel == 0 || len < (size_t)cfg->compressMinSize) {
+        return 0;
+    }
+    return len >= (size_t)cfg->compressLargeSize ? cfg->compressLargeLevel : cfg->compressLevel;
+}
+
+// Compresses data, passing the output to sink as it's produced so it never has to be held in full
+// Returns false if zlib fails or the sink aborts
+bool compressStream(const content_encoding encoding, const int level, const char *data, const size_t len,
+                    const compress_sink sink, void *ctx) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    // 16 more window bits asks for a gzip wrapper instead of the zlib one HTTP calls deflate
+    const int windowBits = encoding == ENCODING_GZIP ? 15 + 16 : 15;
+
+    if (deflateInit2(&stream, level, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        printf("Error initializing compression\n");
+        return false;
+    }
+
+    char out[COMPRESS_CHUNK_SIZE];
+    size_t consumed = 0;
+    bool ok = true;
+    int flush;
+
+    do {
+        const size_t slice = len - consumed < COMPRESS_INPUT_SLICE ? len - consumed : COMPRESS_INPUT_SLICE;
+        stream.next_in = (Bytef *)data + consumed;
+        stream.avail_in = slice;
+        consumed += slice;
+        flush = consumed == len ? Z_FINISH : Z_NO_FLUSH;
+
+        // A full output buffer means zlib may have more to give for this slice
+        do {
+            stream.next_out = (Bytef *)out;
+            stream.avail_out = sizeof(out);
+
+            if (deflate(&stream, flush) == Z_STREAM_ERROR) {
+                printf("Error compressing response\n");
+                ok = false;
+                break;
+            }
+            const size_t produced = sizeof(out) - stream.avail_out;
+
+            if (produced > 0 && !sink(ctx, out, produced)) {
+                ok = false;
+                break;
+            }
+        } while (stream.avail_out == 0);
+    } while (ok && flush != Z_FINISH);
+
+    deflateEnd(&stream);
+    return ok;
+}
+
+// Defines a struct for the growing buffer behind compressToBuffer
+typedef struct output_buffer {
+    char *data;
+    size_t len;
+    size_t capacity;
+} output_buffer;
+
+static bool append_output(void *ctx, const char *data, const size_t len) {
+    output_buffer *output = ctx;
+
+    if (output->len + len > output->capacity) {
+        size_t capacity = output->capacity > 0 ? output->capacity * 2 : COMPRESS_CHUNK_SIZE;
+
+        while (capacity < output->len + len) {
+            capacity *= 2;
+        }
+        char *grown = realloc(output->data, capacity);
+
+        if (grown == NULL) {
+            printf("Error allocating memory for compressed response\n");
+            return false;
+        }
+        output->data = grown;
+        output->capacity = capacity;
+    }
+    memcpy(output->data + output->len, data, len);
+    output->len += len;
+    return true;
+}
+
+// Compresses data into a new buffer, which the caller frees
+bool compressToBuffer(const content_encoding encoding, const int level, const char *data, const size_t len,
+                      char **out, size_t *outLen) {
+    output_buffer output = { NULL, 0, 0 };
+
+    if (!compressStream(encoding, level, data, len, append_output, &output)) {
+        free(output.data);
+        return false;
+    }
+    *out = output.data;
+    *outLen = output.len;
+    return true;
+}
+
+compression_cache* create_compression_cache() {
+    compression_cache *cache = malloc(sizeof(compression_cache));
+
+    if (cache == NULL) {
+        printf("Error creating compression cache\n");
+        return NULL;
+    }
+    cache->entries = NULL;
+    cache->bytes = 0;
+    pthread_mutex_init(&cache->lock, NULL);
+    return cache;
+}
+
+static void free_entry(compressed_entry *entry) {
+    free(entry->key);
+    free(entry->data);
+    free(entry);
+}
+
+// Drops one reference, freeing the entry with the last one
+void compression_cache_release(compressed_entry *entry) {
+    if (atomic_fetch_sub_explicit(&entry->refs, 1, memory_order_acq_rel) == 1) {
+        free_entry(entry);
+    }
+}
+
+// Looks up the cached variant of key, which the caller sends from and then releases
+// Returns NULL on a miss
+compressed_entry* compression_cache_get(compression_cache *cache, const char *key, const content_encoding encoding,
+                                        const int level) {
+    compressed_entry *found = NULL;
+    pthread_mutex_lock(&cache->lock);
+
+    for (compressed_entry **link = &cache->entries; *link != NULL; link = &(*link)->next) {
+        compressed_entry *entry = *link;
+
+        if (entry->encoding != encoding || entry->level != level || strcmp(entry->key, key) != 0) {
+            continue;
+        }
+        // Taken under the lock, so the cache's own reference keeps it alive until then
+        atomic_fetch_add_explicit(&entry->refs, 1, memory_order_relaxed);
+        found = entry;
+
+        // Move it to the front so the least recently used variant is the one evicted
+        *link = entry->next;
+        entry->next = cache->entries;
+        cache->entries = entry;
+        break;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return found;
+}
+
+// Caches data, which the entry takes over, evicting the least recently used variants to stay under maxBytes
+// Returns the entry with a reference for the caller to release, or NULL if it wasn't cached and data is still the caller's
+compressed_entry* compression_cache_put(compression_cache *cache, const char *key, const content_encoding encoding,
+                                        const int level, char *data, const size_t len, const size_t maxBytes) {
+    if (len > maxBytes) {
+        return NULL;
+    }
+    compressed_entry *entry = malloc(sizeof(compressed_entry));
+
+    if (entry == NULL) {
+        return NULL;
+    }
+    entry->key = strdup(key);
+
+    if (entry->key == NULL) {
+        free(entry);
+        return NULL;
+    }
+    entry->data = data;
+    entry->len = len;
+    entry->encoding = encoding;
+    entry->level = level;
+    atomic_init(&entry->refs, 2);
+
+    pthread_mutex_lock(&cache->lock);
+    entry->next = cache->entries;
+    cache->entries = entry;
+    cache->bytes += len;
+
+    // Drop from the tail until the budget is met, another thread may have cached the same variant meanwhile
+    // Requests still sending an evicted entry keep it alive until they release it
+    while (cache->bytes > maxBytes) {
+        compressed_entry **link = &cache->entries;
+
+        while ((*link)->next != NULL) {
+            link = &(*link)->next;
+        }
+        compressed_entry *evicted = *link;
+        *link = NULL;
+        cache->bytes -= evicted->len;
+        compression_cache_release(evicted);
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return entry;
+}
+
+void free_compression_cache(compression_cache *cache) {
+    while (cache->entries != NULL) {
+        compressed_entry *next = cache->entries->next;
+        compression_cache_release(cache->entries);
+        cache->entries = next;
+    }
+    pthread_mutex_destroy(&cache->lock);
+    free(cache);
+}
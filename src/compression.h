@@ -0,0 +1,52 @@
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "config.h"
+
+typedef enum content_encoding {
+    ENCODING_IDENTITY,
+    ENCODING_GZIP,
+    ENCODING_DEFLATE
+} content_encoding;
+
+// Receives the compressed output one chunk at a time, returns false to abort
+typedef bool (*compress_sink)(void *ctx, const char *data, size_t len);
+
+// Defines a struct for a compressed copy of a response body that never changes
+// Requests send straight from data, the entry is freed once it's evicted and the last of them releases it
+typedef struct compressed_entry {
+    char *key;
+    content_encoding encoding;
+    int level;
+    char *data;
+    size_t len;
+    atomic_int refs;    // One while the cache lists it, plus one per request sending it
+    struct compressed_entry *next;
+} compressed_entry;
+
+// Defines a struct for the compressed variants of static responses, most recently used first
+typedef struct compression_cache {
+    compressed_entry *entries;
+    size_t bytes;
+    pthread_mutex_t lock;
+} compression_cache;
+
+content_encoding negotiateEncoding(const char *acceptEncoding);
+const char* encodingName(content_encoding encoding);
+int compressionLevel(const config *cfg, size_t len);
+bool compressStream(content_encoding encoding, int level, const char *data, size_t len, compress_sink sink, void *ctx);
+bool compressToBuffer(content_encoding encoding, int level, const char *data, size_t len, char **out, size_t *outLen);
+
+compression_cache* create_compression_cache();
+compressed_entry* compression_cache_get(compression_cache *cache, const char *key, content_encoding encoding,
+                                        int level);
+compressed_entry* compression_cache_put(compression_cache *cache, const char *key, content_encoding encoding,
+                                        int level, char *data, size_t len, size_t maxBytes);
+void compression_cache_release(compressed_entry *entry);
+void free_compression_cache(compression_cache *cache);
+
+#endif //COMPRESSION_H
@@ -0,0 +1,381 @@
+#include "config.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include "toolbox.h"
+
+// Defines a struct describing an integer setting, shared by the config file and the command line
+typedef struct int_setting {
+    const char *key;    // Key in the config file
+    const char *flag;   // Command line flag
+    size_t offset;      // Offset of the field in config
+    int min;
+    int max;
+} int_setting;
+
+static const int_setting int_settings[] = {
+    { "workers",        "--workers",         offsetof(config, workers),           1, 1024 },
+    { "poolWorkers",    "--pool-workers",    offsetof(config, poolWorkers),       0, 1024 },
+    { "backlog",        "--backlog",         offsetof(config, backlog),           1, 65535 },
+    { "deferAccept",    "--defer-accept",    offsetof(config, deferAcceptSec),    0, 3600 },
+    { "fastOpen",       "--fast-open",       offsetof(config, fastOpenQueue),     0, 65535 },
+    { "tcpNoDelay",     "--tcp-nodelay",     offsetof(config, tcpNoDelay),        0, 1 },
+    { "tcpCork",        "--tcp-cork",        offsetof(config, tcpCork),           0, 1 },
+    { "rcvBuf",         "--rcvbuf",          offsetof(config, rcvBuf),            0, 64 * 1024 * 1024 },
+    { "sndBuf",         "--sndbuf",          offsetof(config, sndBuf),            0, 64 * 1024 * 1024 },
+    { "busyPoll",       "--busy-poll",       offsetof(config, busyPollUsec),      0, 1000000 },
+    { "bufferSize",     "--buffer-size",     offsetof(config, bufferSize),        256, 64 * 1024 * 1024 },
+    { "maxBodySize",    "--max-body-size",   offsetof(config, maxBodySize),       1, 1024 * 1024 * 1024 },
+    { "requestTimeout", "--request-timeout", offsetof(config, requestTimeoutSec), 1, 3600 },
+    { "handoffTimeout", "--handoff-timeout", offsetof(config, handoffTimeoutSec), 1, 3600 },
+    { "drainTimeout",   "--drain-timeout",   offsetof(config, drainTimeoutSec),   0, 3600 },
+    { "maxKvp",         "--max-kvp",         offsetof(config, maxKvp),            1, 1024 * 1024 },
+    { "tableCapacity",  "--table-capacity",  offsetof(config, tableCapacity),     1, 16 * 1024 * 1024 },
+    { "ingestChunkSize", "--ingest-chunk-size", offsetof(config, ingestChunkSize), 1024, 64 * 1024 * 1024 },
+    { "maxDocuments",   "--max-documents",   offsetof(config, maxDocuments),      0, 1 << 30 },
+    { "offloadThreshold", "--offload-threshold", offsetof(config, offloadThreshold), 0, 1024 * 1024 * 1024 },
+    { "maxStreams",     "--max-streams",     offsetof(config, maxStreams),        1, 65536 },
+    { "compressLevel",  "--compress-level",  offsetof(config, compressLevel),     0, 9 },
+    { "compressLargeLevel", "--compress-large-level", offsetof(config, compressLargeLevel), 1, 9 },
+    { "compressMinSize", "--compress-min-size", offsetof(config, compressMinSize), 0, 1024 * 1024 * 1024 },
+    { "compressLargeSize", "--compress-large-size", offsetof(config, compressLargeSize), 0, 1024 * 1024 * 1024 },
+    { "compressCacheSize", "--compress-cache-size", offsetof(config, compressCacheSize), 0, 1024 * 1024 * 1024 },
+};
+
+#define INT_SETTINGS_COUNT (sizeof(int_settings) / sizeof(int_settings[0]))
+
+static config currentConfig;
+static pthread_mutex_t configLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Kept so a reload can re-apply the command line on top of the file
+static int savedArgc;
+static char **savedArgv;
+static const char *configPath = NULL;
+
+static void set_defaults(config *cfg) {
+    memset(cfg, 0, sizeof(config));
+    strcpy(cfg->listen[0].host, DEFAULT_HOST);
+    cfg->listen[0].port = DEFAULT_PORT;
+    cfg->listenCount = 1;
+    cfg->workers = DEFAULT_WORKERS;
+    cfg->backlog = SOMAXCONN;
+    cfg->bufferSize = DEFAULT_BUFFER_SIZE;
+    cfg->maxBodySize = DEFAULT_MAX_BODY_SIZE;
+    cfg->requestTimeoutSec = DEFAULT_REQUEST_TIMEOUT_SEC;
+    cfg->handoffTimeoutSec = DEFAULT_HANDOFF_TIMEOUT_SEC;
+    cfg->drainTimeoutSec = DEFAULT_DRAIN_TIMEOUT_SEC;
+    cfg->maxKvp = DEFAULT_MAX_KVP;
+    cfg->tableCapacity = DEFAULT_CAPACITY;
+    cfg->ingestChunkSize = DEFAULT_INGEST_CHUNK_SIZE;
+    cfg->maxDocuments = DEFAULT_MAX_DOCUMENTS;
+    cfg->offloadThreshold = DEFAULT_OFFLOAD_THRESHOLD;
+    cfg->maxStreams = DEFAULT_MAX_STREAMS;
+    cfg->compressLevel = DEFAULT_COMPRESS_LEVEL;
+    cfg->compressLargeLevel = DEFAULT_COMPRESS_LARGE_LEVEL;
+    cfg->compressMinSize = DEFAULT_COMPRESS_MIN_SIZE;
+    cfg->compressLargeSize = DEFAULT_COMPRESS_LARGE_SIZE;
+    cfg->compressCacheSize = DEFAULT_COMPRESS_CACHE_SIZE;
+}
+
+static bool set_int(config *cfg, const int_setting *setting, const int64_t value) {
+    if (value < setting->min || value > setting->max) {
+        printf("Config error: %s must be between %d and %d\n", setting->key, setting->min, setting->max);
+        return false;
+    }
+    *(int *)((char *)cfg + setting->offset) = (int)value;
+    return true;
+}
+
+// Parses "host:port", ":port" or "port"
+static bool parse_listen_address(const char *value, listen_address *out) {
+    const char *colon = strrchr(value, ':');
+    const char *port = colon != NULL ? colon + 1 : value;
+    const size_t hostLen = colon != NULL ? (size_t)(colon - value) : 0;
+    int64_t portValue;
+
+    if (hostLen >= MAX_HOST_SIZE || !parseInt64(port, strlen(port), &portValue) || portValue <= 0 || portValue > 65535) {
+        printf("Config error: invalid listen address %s\n", value);
+        return false;
+    }
+
+    if (hostLen == 0) {
+        strcpy(out->host, DEFAULT_HOST);
+    } else {
+        memcpy(out->host, value, hostLen);
+        out->host[hostLen] = '\0';
+    }
+    out->port = (int)portValue;
+    return true;
+}
+
+static bool add_listen_address(config *cfg, const char *value) {
+    if (cfg->listenCount >= MAX_LISTENERS) {
+        printf("Config error: at most %d listen addresses are supported\n", MAX_LISTENERS);
+        return false;
+    }
+    return parse_listen_address(value, &cfg->listen[cfg->listenCount++]);
+}
+
+// Parses a comma separated list of listen addresses
+static bool parse_listen_list(config *cfg, const char *value) {
+    char *list = strdup(value);
+    bool ok = list != NULL;
+    cfg->listenCount = 0;
+
+    for (char *save = NULL, *address = strtok_r(list, ",", &save); ok && address != NULL; address = strtok_r(NULL, ",", &save)) {
+        ok = add_listen_address(cfg, address);
+    }
+    free(list);
+    return ok && cfg->listenCount > 0;
+}
+
+static bool add_listen_item(config *cfg, const hashtable_item *item) {
+    if (item->type != STRING) {
+        printf("Config error: listen addresses must be strings\n");
+        return false;
+    }
+    return add_listen_address(cfg, item->value);
+}
+
+// The JSON parser splits on commas, so a list in the file is written as an object: { "name": "host:port", ... }
+static bool parse_listen_table(config *cfg, const hashtable *table) {
+    bool ok = true;
+    cfg->listenCount = 0;
+
+    for (int i = 0; ok && i < table->size; i++) {
+        if (table->items[i] != NULL) {
+            ok = add_listen_item(cfg, table->items[i]);
+        }
+        for (const Node *node = table->overflow_buckets[i]; ok && node != NULL; node = node->next) {
+            ok = add_listen_item(cfg, node->item);
+        }
+    }
+    return ok && cfg->listenCount > 0;
+}
+
+static char* read_file(const char *path) {
+    FILE *file = fopen(path, "rb");
+
+    if (file == NULL) {
+        perror("webserver (config)");
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    const long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char *contents = size >= 0 ? malloc(size + 1) : NULL;
+
+    if (contents == NULL || fread(contents, 1, size, file) != (size_t)size) {
+        printf("Error reading config file %s\n", path);
+        free(contents);
+        fclose(file);
+        return NULL;
+    }
+    contents[size] = '\0';
+    fclose(file);
+    return contents;
+}
+
+static bool load_file(const char *path, config *cfg) {
+    char *contents = read_file(path);
+
+    if (contents == NULL) {
+        return false;
+    }
+    hashtable *table = parseJSON(contents);
+    free(contents);
+
+    if (table == NULL) {
+        printf("Config error: %s is not a valid JSON object\n", path);
+        return false;
+    }
+    bool ok = true;
+    char key[64];
+
+    // Keys keep their quotes in the parsed table
+    for (size_t i = 0; ok && i < INT_SETTINGS_COUNT; i++) {
+        snprintf(key, sizeof(key), "\"%s\"", int_settings[i].key);
+        const hashtable_item *item = hashtable_search(table, key);
+
+        if (item == NULL) {
+            continue;
+        }
+        if (item->type != INT) {
+            printf("Config error: %s must be an integer\n", int_settings[i].key);
+            ok = false;
+            continue;
+        }
+        ok = set_int(cfg, &int_settings[i], *(int64_t *)item->value);
+    }
+
+    const hashtable_item *listen = hashtable_search(table, "\"listen\"");
+
+    if (ok && listen != NULL) {
+        if (listen->type == STRING) {
+            cfg->listenCount = 0;
+            ok = add_listen_address(cfg, listen->value);
+        } else if (listen->type == HASHTABLE) {
+            ok = parse_listen_table(cfg, listen->value);
+        } else {
+            printf("Config error: listen must be a string or an object\n");
+            ok = false;
+        }
+    }
+    free_table(table);
+    return ok;
+}
+
+static void print_usage(const char *program) {
+    printf("Usage: %s [--config file] [--listen host:port,...]", program);
+
+    for (size_t i = 0; i < INT_SETTINGS_COUNT; i++) {
+        printf(" [%s n]", int_settings[i].flag);
+    }
+    printf("\n");
+}
+
+// Applies command line overrides, accepts both "--flag value" and "--flag=value"
+static bool apply_args(const int argc, char **argv, config *cfg) {
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *equals = strchr(arg, '=');
+        const size_t flagLen = equals != NULL ? (size_t)(equals - arg) : strlen(arg);
+        const char *value = equals != NULL ? equals + 1 : (i + 1 < argc ? argv[i + 1] : NULL);
+        bool known = false;
+        bool ok = true;
+
+        if (value == NULL) {
+            printf("Missing value for %s\n", arg);
+            print_usage(argv[0]);
+            return false;
+        }
+
+        if (strncmp(arg, "--config", flagLen) == 0 && flagLen == strlen("--config")) {
+            // Already handled by initConfig()
+            known = true;
+        } else if (strncmp(arg, "--listen", flagLen) == 0 && flagLen == strlen("--listen")) {
+            known = true;
+            ok = parse_listen_list(cfg, value);
+        } else {
+            for (size_t j = 0; j < INT_SETTINGS_COUNT; j++) {
+                if (strncmp(arg, int_settings[j].flag, flagLen) == 0 && flagLen == strlen(int_settings[j].flag)) {
+                    int64_t number;
+                    known = true;
+
+                    if (!parseInt64(value, strlen(value), &number)) {
+                        printf("%s expects an integer\n", int_settings[j].flag);
+                        ok = false;
+                    } else {
+                        ok = set_int(cfg, &int_settings[j], number);
+                    }
+                    break;
+                }
+            }
+        }
+
+        if (!known) {
+            printf("Unknown option %s\n", arg);
+            print_usage(argv[0]);
+            return false;
+        }
+        if (!ok) {
+            return false;
+        }
+        if (equals == NULL) {
+            i++;
+        }
+    }
+    return true;
+}
+
+// Builds a configuration from the defaults, the config file and the command line, in that order
+static bool build_config(config *cfg) {
+    set_defaults(cfg);
+
+    if (configPath != NULL && !load_file(configPath, cfg)) {
+        return false;
+    }
+    if (!apply_args(savedArgc, savedArgv, cfg)) {
+        return false;
+    }
+
+    // Valid on its own, but no body could ever reach the pool
+    if (cfg->offloadThreshold > cfg->maxBodySize) {
+        printf("Config warning: offloadThreshold (%d) is above maxBodySize (%d), no request body will be offloaded\n",
+               cfg->offloadThreshold, cfg->maxBodySize);
+    }
+    return true;
+}
+
+bool initConfig(const int argc, char **argv) {
+    savedArgc = argc;
+    savedArgv = argv;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--config=", strlen("--config=")) == 0) {
+            configPath = argv[i] + strlen("--config=");
+        } else if (strcmp(argv[i], "--config") == 0 && i + 1 < argc) {
+            configPath = argv[i + 1];
+        }
+    }
+
+    // The config file goes through parseJSON(), which reads the current settings
+    config cfg;
+    set_defaults(&cfg);
+    setConfig(&cfg);
+
+    if (!build_config(&cfg)) {
+        return false;
+    }
+    setConfig(&cfg);
+    return true;
+}
+
+// Re-reads the config file and applies every setting that doesn't need new sockets or threads
+bool reloadConfig() {
+    config cfg;
+
+    if (!build_config(&cfg)) {
+        printf("Config reload failed, keeping the current settings\n");
+        return false;
+    }
+
+    pthread_mutex_lock(&configLock);
+
+    if (cfg.listenCount != currentConfig.listenCount ||
+        memcmp(cfg.listen, currentConfig.listen, sizeof(cfg.listen)) != 0 ||
+        cfg.workers != currentConfig.workers || cfg.poolWorkers != currentConfig.poolWorkers ||
+        cfg.backlog != currentConfig.backlog ||
+        cfg.deferAcceptSec != currentConfig.deferAcceptSec || cfg.fastOpenQueue != currentConfig.fastOpenQueue) {
+        printf("listen, workers, poolWorkers, backlog, deferAccept and fastOpen changes only apply after a restart (SIGUSR2)\n");
+    }
+    memcpy(cfg.listen, currentConfig.listen, sizeof(cfg.listen));
+    cfg.listenCount = currentConfig.listenCount;
+    cfg.workers = currentConfig.workers;
+    cfg.poolWorkers = currentConfig.poolWorkers;
+    cfg.backlog = currentConfig.backlog;
+    cfg.deferAcceptSec = currentConfig.deferAcceptSec;
+    cfg.fastOpenQueue = currentConfig.fastOpenQueue;
+    currentConfig = cfg;
+
+    pthread_mutex_unlock(&configLock);
+    printf("config reloaded\n");
+    return true;
+}
+
+void getConfig(config *out) {
+    pthread_mutex_lock(&configLock);
+    *out = currentConfig;
+    pthread_mutex_unlock(&configLock);
+}
+
+void setConfig(const config *cfg) {
+    pthread_mutex_lock(&configLock);
+    currentConfig = *cfg;
+    pthread_mutex_unlock(&configLock);
+}
@@ -0,0 +1,53 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdbool.h>
+#include "constants.h"
+
+#define MAX_HOST_SIZE 64
+
+// Defines a struct for an address to listen on
+typedef struct listen_address {
+    char host[MAX_HOST_SIZE];
+    int port;
+} listen_address;
+
+// Defines a struct for the runtime configuration
+// Fields marked structural only take effect on a restart (SIGUSR2), the others are applied on a reload (SIGHUP)
+typedef struct config {
+    listen_address listen[MAX_LISTENERS];   // structural
+    int listenCount;                        // structural
+    int workers;                            // structural
+    int poolWorkers;                        // structural, threads parsing in the background (0 = one per CPU)
+    int backlog;                            // structural
+    int deferAcceptSec;                     // structural, TCP_DEFER_ACCEPT on the listeners (0 = off)
+    int fastOpenQueue;                      // structural, TCP_FASTOPEN queue length on the listeners (0 = off)
+    int tcpNoDelay;                         // TCP_NODELAY on accepted sockets
+    int tcpCork;                            // TCP_CORK around the header and body writes of a response
+    int rcvBuf;                             // SO_RCVBUF on accepted sockets (0 = kernel default)
+    int sndBuf;                             // SO_SNDBUF on accepted sockets (0 = kernel default)
+    int busyPollUsec;                       // SO_BUSY_POLL on accepted sockets (0 = off)
+    int bufferSize;
+    int maxBodySize;
+    int requestTimeoutSec;
+    int handoffTimeoutSec;
+    int drainTimeoutSec;
+    int maxKvp;
+    int tableCapacity;
+    int ingestChunkSize;                    // Bytes of NDJSON gathered before they're parsed as one task
+    int maxDocuments;                       // Documents kept in the document store
+    int offloadThreshold;                   // Bodies of at least this many bytes are parsed on the thread pool (0 = always)
+    int maxStreams;                         // Request bodies read on threads of their own at once, more get a 503
+    int compressLevel;                      // zlib level for compressed responses (0 = never compress)
+    int compressLargeLevel;                 // zlib level for bodies of at least compressLargeSize bytes
+    int compressMinSize;                    // Bodies smaller than this are sent uncompressed
+    int compressLargeSize;
+    int compressCacheSize;                  // Bytes of compressed static responses kept in memory (0 = off)
+} config;
+
+bool initConfig(int argc, char **argv);
+bool reloadConfig();
+void getConfig(config *out);
+void setConfig(const config *cfg);
+
+#endif //CONFIG_H
@@ -5,9 +5,31 @@
 #ifndef CONSTANTS_H
 #define CONSTANTS_H
 
-#define PORT 8080
-#define BUFFER_SIZE 1024
-#define MAX_KVP 1024
+// Defaults for the runtime configuration, see config.h
+#define DEFAULT_HOST "0.0.0.0"
+#define DEFAULT_PORT 8080
+#define DEFAULT_WORKERS 1
+#define DEFAULT_BUFFER_SIZE 1024
+#define DEFAULT_MAX_BODY_SIZE (1024 * 1024)   // Above DEFAULT_OFFLOAD_THRESHOLD so big bodies reach the pool
+#define DEFAULT_MAX_KVP 1024
+#define DEFAULT_REQUEST_TIMEOUT_SEC 5   // Max time a single request can block a worker
+#define DEFAULT_HANDOFF_TIMEOUT_SEC 10  // Max time to wait for the new process during a restart
+#define DEFAULT_DRAIN_TIMEOUT_SEC 30    // Max time to wait for in-flight requests after a restart
+#define DEFAULT_INGEST_CHUNK_SIZE (64 * 1024)
+#define DEFAULT_MAX_DOCUMENTS 10000
+#define DEFAULT_OFFLOAD_THRESHOLD (16 * 1024)
+#define DEFAULT_MAX_STREAMS 64
+#define DEFAULT_COMPRESS_LEVEL 6
+#define DEFAULT_COMPRESS_LARGE_LEVEL 1
+#define DEFAULT_COMPRESS_MIN_SIZE 1024   // Above every body served today, lower it to compress them
+#define DEFAULT_COMPRESS_LARGE_SIZE (256 * 1024)
+#define DEFAULT_COMPRESS_CACHE_SIZE (1024 * 1024)
+
+#define MAX_LISTENERS 8
+#define MAX_METHOD_SIZE 16
+#define MAX_URI_SIZE 2048
+#define MAX_VERSION_SIZE 16
+#define MAX_JSON_DEPTH 32
 
 // Defines an enum for the type of a value
 typedef enum { INT, FLOAT, BOOL, STRING, HASHTABLE, NULL_TYPE } ValueType;
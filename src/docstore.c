@@ -0,0 +1,76 @@
+#include "docstore.h"
+
+#define INITIAL_DOCSTORE_CAPACITY 1024
+
+docstore* create_docstore() {
+    docstore *store = malloc(sizeof(docstore));
+
+    if (store == NULL) {
+        printf("Error creating document store\n");
+        return NULL;
+    }
+    store->documents = NULL;
+    store->count = 0;
+    store->capacity = 0;
+    pthread_mutex_init(&store->lock, NULL);
+    return store;
+}
+
+// Makes room for count more documents, called with the lock held
+static bool reserve(docstore *store, const int count) {
+    if (store->count + count <= store->capacity) {
+        return true;
+    }
+    int capacity = store->capacity > 0 ? store->capacity : INITIAL_DOCSTORE_CAPACITY;
+
+    while (capacity < store->count + count) {
+        capacity *= 2;
+    }
+    hashtable **documents = realloc(store->documents, sizeof(hashtable *) * capacity);
+
+    if (documents == NULL) {
+        printf("Error growing document store\n");
+        return false;
+    }
+    store->documents = documents;
+    store->capacity = capacity;
+    return true;
+}
+
+// Takes ownership of the documents and inserts as many as fit under maxDocuments with a single lock
+// The store never evicts: once it holds maxDocuments, documents are rejected (freed) rather than replacing old ones,
+// and /ingest answers 507 for the stream. Returns the number inserted
+int docstore_insert_batch(docstore *store, hashtable **documents, const int count, const int maxDocuments) {
+    pthread_mutex_lock(&store->lock);
+    const int room = maxDocuments - store->count;
+    int inserted = count < room ? count : room;
+
+    if (inserted < 0 || !reserve(store, inserted)) {
+        inserted = 0;
+    }
+    for (int i = 0; i < inserted; i++) {
+        store->documents[store->count++] = documents[i];
+    }
+    pthread_mutex_unlock(&store->lock);
+
+    for (int i = inserted; i < count; i++) {
+        free_table(documents[i]);
+    }
+    return inserted;
+}
+
+int docstore_count(docstore *store) {
+    pthread_mutex_lock(&store->lock);
+    const int count = store->count;
+    pthread_mutex_unlock(&store->lock);
+    return count;
+}
+
+void free_docstore(docstore *store) {
+    for (int i = 0; i < store->count; i++) {
+        free_table(store->documents[i]);
+    }
+    pthread_mutex_destroy(&store->lock);
+    free(store->documents);
+    free(store);
+}
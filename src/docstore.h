@@ -0,0 +1,21 @@
+#ifndef DOCSTORE_H
+#define DOCSTORE_H
+
+#include <pthread.h>
+#include "my_hashtable.h"
+
+// Defines a struct for the in-memory store of parsed JSON documents
+// A document's id is its index in documents, documents are never evicted
+typedef struct docstore {
+    hashtable **documents;
+    int count;
+    int capacity;
+    pthread_mutex_t lock;
+} docstore;
+
+docstore* create_docstore();
+int docstore_insert_batch(docstore *store, hashtable **documents, int count, int maxDocuments);
+int docstore_count(docstore *store);
+void free_docstore(docstore *store);
+
+#endif //DOCSTORE_H
@@ -0,0 +1,63 @@
+#include "http.h"
+
+#include <string.h>
+#include <strings.h>
+
+// Copies the token starting at *cursor into out, stopping at a space or the end of the line
+// Returns false if the token is empty or doesn't fit, out is always terminated
+static bool readToken(const char **cursor, const char *lineEnd, char *out, const size_t outSize) {
+    const char *start = *cursor;
+
+    while (*cursor < lineEnd && **cursor != ' ') {
+        (*cursor)++;
+    }
+    const size_t len = *cursor - start;
+    out[0] = '\0';
+
+    if (len == 0 || len >= outSize) {
+        return false;
+    }
+    memcpy(out, start, len);
+    out[len] = '\0';
+    return true;
+}
+
+// Parses the request line and finds the end of the headers in a NUL-terminated buffer
+// Returns false if the headers aren't complete or the request line isn't "METHOD URI VERSION"
+bool parseRequestHead(const char *buffer, http_request *request) {
+    request->headerEnd = strstr(buffer, "\r\n\r\n");
+
+    if (request->headerEnd == NULL) {
+        return false;
+    }
+    request->headersLen = request->headerEnd - buffer + 4;
+
+    // The first CRLF is at the latest the one starting the blank line
+    const char *lineEnd = strstr(buffer, "\r\n");
+    const char *cursor = buffer;
+
+    if (!readToken(&cursor, lineEnd, request->method, sizeof(request->method)) || cursor == lineEnd) {
+        return false;
+    }
+    cursor++;
+
+    if (!readToken(&cursor, lineEnd, request->uri, sizeof(request->uri)) || cursor == lineEnd) {
+        return false;
+    }
+    cursor++;
+    return readToken(&cursor, lineEnd, request->version, sizeof(request->version)) && cursor == lineEnd;
+}
+
+// Finds the value of a header, name includes the ": " separator
+// Only the start of the header lines between the request line and the blank line is matched
+// Returns NULL if the header isn't there
+const char* findHeader(const char *buffer, const char *headerEnd, const char *name) {
+    const size_t nameLen = strlen(name);
+
+    for (const char *line = strstr(buffer, "\r\n"); line != NULL && line < headerEnd; line = strstr(line + 2, "\r\n")) {
+        if (strncasecmp(line + 2, name, nameLen) == 0) {
+            return line + 2 + nameLen;
+        }
+    }
+    return NULL;
+}
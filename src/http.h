@@ -0,0 +1,19 @@
+#ifndef HTTP_H
+#define HTTP_H
+
+#include <stdbool.h>
+#include "constants.h"
+
+// Defines a struct for the request line and the extent of the headers of a request
+typedef struct http_request {
+    char method[MAX_METHOD_SIZE];
+    char uri[MAX_URI_SIZE];
+    char version[MAX_VERSION_SIZE];
+    const char *headerEnd;  // The blank line ending the headers, inside the parsed buffer
+    int headersLen;         // Bytes up to and including the blank line
+} http_request;
+
+bool parseRequestHead(const char *buffer, http_request *request);
+const char* findHeader(const char *buffer, const char *headerEnd, const char *name);
+
+#endif //HTTP_H
@@ -0,0 +1,233 @@
+// memrchr()
+#define _GNU_SOURCE
+#include "ingest.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "toolbox.h"
+
+// Segments queued per pool worker before the reader waits for the oldest one
+#define IN_FLIGHT_PER_WORKER 2
+
+static bool is_blank(const char *line) {
+    for (; *line != '\0'; line++) {
+        if (!isspace((unsigned char)*line)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Parses every record of a segment, runs on the thread pool
+static void parse_segment(void *arg) {
+    ingest_segment *segment = arg;
+    int lines = 1;
+
+    for (const char *c = segment->data; (c = memchr(c, '\n', segment->data + segment->len - c)) != NULL; c++) {
+        lines++;
+    }
+    segment->documents = malloc(sizeof(hashtable *) * lines);
+
+    if (segment->documents == NULL) {
+        printf("Error allocating memory for ingested documents\n");
+        segment->failed = lines;
+    }
+
+    char *line = segment->data;
+    char *const end = segment->data + segment->len;
+
+    while (segment->documents != NULL && line < end) {
+        char *newline = memchr(line, '\n', end - line);
+        char *lineEnd = newline != NULL ? newline : end;
+        *lineEnd = '\0';
+
+        if (!is_blank(line)) {
+            hashtable *document = parseJSONWithConfig(line, &segment->stream->cfg);
+
+            if (document != NULL) {
+                segment->documents[segment->parsed++] = document;
+            } else {
+                segment->failed++;
+            }
+        }
+        line = lineEnd + 1;
+    }
+
+    pthread_mutex_lock(&segment->stream->lock);
+    segment->done = true;
+    pthread_cond_broadcast(&segment->stream->segmentDone);
+    pthread_mutex_unlock(&segment->stream->lock);
+}
+
+// Waits for the oldest segment and inserts its documents into the store as one batch
+static void complete_oldest(ingest_stream *stream) {
+    ingest_segment *segment = stream->inFlight[0];
+
+    pthread_mutex_lock(&stream->lock);
+    while (!segment->done) {
+        pthread_cond_wait(&stream->segmentDone, &stream->lock);
+    }
+    pthread_mutex_unlock(&stream->lock);
+
+    const int inserted = segment->parsed > 0
+        ? docstore_insert_batch(stream->store, segment->documents, segment->parsed, stream->maxDocuments)
+        : 0;
+    stream->ingested += inserted;
+    stream->failed += segment->failed;
+    stream->rejected += segment->parsed - inserted;
+
+    free(segment->documents);
+    free(segment->data);
+    free(segment);
+    stream->inFlightCount--;
+    memmove(stream->inFlight, stream->inFlight + 1, sizeof(ingest_segment *) * stream->inFlightCount);
+}
+
+// Hands data (which must have room for a terminator at data[len]) to the pool
+static bool submit_segment(ingest_stream *stream, char *data, const size_t len) {
+    if (stream->inFlightCount == stream->maxInFlight) {
+        complete_oldest(stream);
+    }
+    ingest_segment *segment = calloc(1, sizeof(ingest_segment));
+
+    if (segment == NULL) {
+        printf("Error allocating memory for ingest segment\n");
+        free(data);
+        return false;
+    }
+    data[len] = '\0';
+    segment->data = data;
+    segment->len = len;
+    segment->stream = stream;
+    stream->inFlight[stream->inFlightCount++] = segment;
+
+    // Parse on this thread rather than drop the records if the pool can't take it
+    if (!thread_pool_submit(stream->pool, parse_segment, segment)) {
+        parse_segment(segment);
+    }
+    return true;
+}
+
+// Records longer than maxBodySize are rejected, the body itself can be any length
+ingest_stream* create_ingest_stream(thread_pool *pool, docstore *store, const config *cfg) {
+    ingest_stream *stream = calloc(1, sizeof(ingest_stream));
+
+    if (stream == NULL) {
+        printf("Error creating ingest stream\n");
+        return NULL;
+    }
+    stream->pool = pool;
+    stream->store = store;
+    stream->cfg = *cfg;
+    stream->maxDocuments = cfg->maxDocuments;
+    stream->chunkSize = cfg->ingestChunkSize;
+    stream->maxRecordSize = cfg->maxBodySize;
+    stream->maxInFlight = pool->workerCount * IN_FLIGHT_PER_WORKER;
+    stream->inFlight = malloc(sizeof(ingest_segment *) * stream->maxInFlight);
+    stream->bufferCapacity = stream->chunkSize + 1;
+    stream->buffer = malloc(stream->bufferCapacity);
+
+    if (stream->inFlight == NULL || stream->buffer == NULL) {
+        printf("Error allocating memory for ingest stream\n");
+        free(stream->inFlight);
+        free(stream->buffer);
+        free(stream);
+        return NULL;
+    }
+    pthread_mutex_init(&stream->lock, NULL);
+    pthread_cond_init(&stream->segmentDone, NULL);
+    return stream;
+}
+
+// Cuts the buffer after its last newline and submits the complete records
+static bool cut_segment(ingest_stream *stream) {
+    const char *lastNewline = memrchr(stream->buffer, '\n', stream->bufferLen);
+
+    if (lastNewline == NULL) {
+        if (stream->bufferLen > stream->maxRecordSize) {
+            printf("Ingest error: record longer than %zu bytes\n", stream->maxRecordSize);
+            return false;
+        }
+        // A single record longer than a chunk, keep reading until it ends
+        return true;
+    }
+
+    // The partial record at the end moves to a fresh buffer, the rest goes to the pool as is
+    const size_t segmentLen = lastNewline - stream->buffer + 1;
+    const size_t remainder = stream->bufferLen - segmentLen;
+    const size_t capacity = (remainder > stream->chunkSize ? remainder : stream->chunkSize) + 1;
+    char *next = malloc(capacity);
+
+    if (next == NULL) {
+        printf("Error allocating memory for ingest buffer\n");
+        return false;
+    }
+    memcpy(next, stream->buffer + segmentLen, remainder);
+
+    char *segmentData = stream->buffer;
+    stream->buffer = next;
+    stream->bufferLen = remainder;
+    stream->bufferCapacity = capacity;
+    return submit_segment(stream, segmentData, segmentLen);
+}
+
+// Appends len bytes of the body, submitting a segment every chunkSize bytes
+bool ingest_feed(ingest_stream *stream, const char *data, const size_t len) {
+    if (stream->bufferLen + len + 1 > stream->bufferCapacity) {
+        size_t capacity = stream->bufferCapacity > 0 ? stream->bufferCapacity * 2 : stream->chunkSize + 1;
+
+        while (capacity < stream->bufferLen + len + 1) {
+            capacity *= 2;
+        }
+        char *buffer = realloc(stream->buffer, capacity);
+
+        if (buffer == NULL) {
+            printf("Error growing ingest buffer\n");
+            return false;
+        }
+        stream->buffer = buffer;
+        stream->bufferCapacity = capacity;
+    }
+    memcpy(stream->buffer + stream->bufferLen, data, len);
+    stream->bufferLen += len;
+
+    return stream->bufferLen < stream->chunkSize || cut_segment(stream);
+}
+
+// Submits the last record, which may not end with a newline, and waits for every segment
+bool ingest_finish(ingest_stream *stream) {
+    bool ok = true;
+
+    if (stream->bufferLen > 0) {
+        if (stream->bufferLen > stream->maxRecordSize && memchr(stream->buffer, '\n', stream->bufferLen) == NULL) {
+            printf("Ingest error: record longer than %zu bytes\n", stream->maxRecordSize);
+            ok = false;
+        } else {
+            char *segmentData = stream->buffer;
+            const size_t segmentLen = stream->bufferLen;
+            stream->buffer = NULL;
+            stream->bufferLen = 0;
+            stream->bufferCapacity = 0;
+            ok = submit_segment(stream, segmentData, segmentLen);
+        }
+    }
+
+    while (stream->inFlightCount > 0) {
+        complete_oldest(stream);
+    }
+    return ok;
+}
+
+// Waits for the segments still being parsed (their records are kept) and frees the stream
+void free_ingest_stream(ingest_stream *stream) {
+    while (stream->inFlightCount > 0) {
+        complete_oldest(stream);
+    }
+    pthread_mutex_destroy(&stream->lock);
+    pthread_cond_destroy(&stream->segmentDone);
+    free(stream->inFlight);
+    free(stream->buffer);
+    free(stream);
+}
@@ -0,0 +1,47 @@
+#ifndef INGEST_H
+#define INGEST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "config.h"
+#include "docstore.h"
+#include "thread_pool.h"
+
+// Defines a struct for a run of complete NDJSON records parsed as one task
+typedef struct ingest_segment {
+    char *data;             // Owned copy of the records, newlines are replaced with terminators while parsing
+    size_t len;
+    hashtable **documents;  // Parsed records, in input order
+    int parsed;
+    int failed;
+    bool done;
+    struct ingest_stream *stream;
+} ingest_segment;
+
+// Defines a struct for an NDJSON body being split into segments and parsed on the thread pool
+typedef struct ingest_stream {
+    thread_pool *pool;
+    docstore *store;
+    config cfg;             // Settings of the request, records are parsed with them
+    int maxDocuments;
+    size_t chunkSize;       // Bytes gathered before a segment is cut at the last newline
+    size_t maxRecordSize;   // Longest record accepted
+    char *buffer;           // Bytes not handed to a segment yet
+    size_t bufferLen;
+    size_t bufferCapacity;
+    ingest_segment **inFlight;  // Submitted segments, oldest first
+    int inFlightCount;
+    int maxInFlight;
+    int ingested;
+    int failed;             // Records that weren't valid JSON objects
+    int rejected;           // Valid records the full document store had no room for
+    pthread_mutex_t lock;
+    pthread_cond_t segmentDone;
+} ingest_stream;
+
+ingest_stream* create_ingest_stream(thread_pool *pool, docstore *store, const config *cfg);
+bool ingest_feed(ingest_stream *stream, const char *data, size_t len);
+bool ingest_finish(ingest_stream *stream);
+void free_ingest_stream(ingest_stream *stream);
+
+#endif //INGEST_H
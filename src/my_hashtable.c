@@ -1,13 +1,13 @@
 
 #include "my_hashtable.h"
 
-unsigned long hash_function(const char *str) {
+unsigned long hash_function(const char *str, const int size) {
     unsigned long hash = 0;
 
     for (int j = 0; str[j]; j++) {
         hash += str[j];
     }
-    return hash % CAPACITY;
+    return hash % size;
 }
 
 Node** create_overflow_buckets(const hashtable *table) {
@@ -35,7 +35,7 @@ void free_overflow_buckets(const hashtable *table) {
     free(buckets);
 }
 
-hashtable* create_table() {
+hashtable* create_table(const int size) {
     // Creates a pointer to a hashtable
     hashtable *table = malloc(sizeof(hashtable));
 
@@ -44,7 +44,7 @@ hashtable* create_table() {
         return NULL;
     }
 
-    table->size = CAPACITY;
+    table->size = size;
     table->count = 0;
     table->items = calloc(table->size, sizeof(hashtable_item *));
 
@@ -109,31 +109,44 @@ void handle_collisions(const hashtable *table, const unsigned long index, hashta
     insert_node(head, item);
 }
 
+// Takes ownership of value, the text of INT, FLOAT and BOOL values is freed once converted
 void hashtable_insert(hashtable *table, const char *key, void *value, const ValueType type) {
     void *value_to_insert = value;
+    ValueType type_to_insert = type;
 
-    // If the value is a int, alloc memory for it and store the pointer
+    // If the value is an int, alloc memory for it and store the pointer
     if (type == INT) {
-        int *int_ptr = malloc(sizeof(int));
+        int64_t *int_ptr = malloc(sizeof(int64_t));
         if (int_ptr == NULL) {
             printf("Error allocating memory for value\n");
+            free(value);
             return;
         }
-        // atoi() converts a string to an int
-        *int_ptr = atoi(value);
-        value_to_insert = int_ptr;
+
+        if (parseInt64(value, strlen(value), int_ptr)) {
+            value_to_insert = int_ptr;
+        } else {
+            // Doesn't fit in 64 bits, keep it as a float instead
+            free(int_ptr);
+            type_to_insert = FLOAT;
+        }
     }
 
-    // TODO : doesn't work for some reason, getting 0.000000 in hashtable
-    // If the value is a int, alloc memory for it and store the pointer
-    if (type == FLOAT) {
-        float *float_ptr = malloc(sizeof(float));
+    // If the value is a float, alloc memory for it and store the pointer
+    if (type_to_insert == FLOAT) {
+        double *float_ptr = malloc(sizeof(double));
         if (float_ptr == NULL) {
             printf("Error allocating memory for value\n");
+            free(value);
+            return;
+        }
+
+        if (!parseDouble(value, strlen(value), float_ptr)) {
+            printf("Invalid number : %s\n", (char*)value);
+            free(float_ptr);
+            free(value);
             return;
         }
-        // atoi() converts a string to an int
-        *float_ptr = atof(value);
         value_to_insert = float_ptr;
     }
 
@@ -142,15 +155,23 @@ void hashtable_insert(hashtable *table, const char *key, void *value, const Valu
         bool *bool_ptr = malloc(sizeof(bool));
         if (bool_ptr == NULL) {
             printf("Error allocating memory for value\n");
+            free(value);
             return;
         }
         *bool_ptr = strcmp(value, "true") == 0 ? true : false;
         value_to_insert = bool_ptr;
     }
-    hashtable_item *item = create_item(key, value_to_insert, type);
+
+    if (value_to_insert != value) {
+        free(value);
+    }
+    hashtable_item *item = create_item(key, value_to_insert, type_to_insert);
 
     if (item == NULL) {
         printf("Error creating item\n");
+        if (value_to_insert != NULL) {
+            type_to_insert == HASHTABLE ? free_table(value_to_insert) : free(value_to_insert);
+        }
         return;
     }
 
@@ -163,7 +184,7 @@ void hashtable_insert(hashtable *table, const char *key, void *value, const Valu
 }
 
 void insert_into_table(hashtable *table, hashtable_item *item) {
-    const int index = hash_function(item->key);
+    const int index = hash_function(item->key, table->size);
     const hashtable_item *current_item = table->items[index];
 
     if (current_item == NULL) {
@@ -182,7 +203,7 @@ void insert_into_table(hashtable *table, hashtable_item *item) {
 
 void hashtable_delete(hashtable *table, const char *key) {
     // Deletes an item from the table
-    const int index = hash_function(key);
+    const int index = hash_function(key, table->size);
     hashtable_item *item = table->items[index];
     Node *head = table->overflow_buckets[index];
 
@@ -209,8 +230,8 @@ void hashtable_delete(hashtable *table, const char *key) {
             Node *node = head;
             head = head->next;
             node->next = NULL;
-            table->items[index] = create_item(node->item->key, node->item->value, node->item->type);
-            table->count++;
+            table->items[index] = node->item;
+            node->item = NULL;
             free_list(node);
             table->overflow_buckets[index] = head;
             return;
@@ -221,9 +242,10 @@ void hashtable_delete(hashtable *table, const char *key) {
         while (current) {
             if (strcmp(current->item->key, key) == 0) {
                 if (previous == NULL) {
-                    // First element of the chain. Remove the chain
-                    free_list(head);
-                    table->overflow_buckets[index] = NULL;
+                    // First element of the chain, the next one becomes the head
+                    table->overflow_buckets[index] = current->next;
+                    current->next = NULL;
+                    free_list(current);
                     return;
                 }
                 // This is somewhere in the chain
@@ -239,7 +261,7 @@ void hashtable_delete(hashtable *table, const char *key) {
     }
 }
 hashtable_item* hashtable_search(const hashtable *table, const char *key) {
-    const int index = hash_function(key);
+    const int index = hash_function(key, table->size);
     hashtable_item *item = table->items[index];
     const Node *head = table->overflow_buckets[index];
 
@@ -285,10 +307,10 @@ void print_value(const hashtable_item *item) {
             printf("%s", (char*)item->value);
             break;
         case INT:
-            printf("%d", *(int*)item->value);
+            printf("%" PRId64, *(int64_t*)item->value);
             break;
         case FLOAT:
-            printf("%8.2f", *(float*)item->value);
+            printf("%8.2f", *(double*)item->value);
             break;
         case BOOL:
             printf("%s", *(bool*)item->value ? "true" : "false");
@@ -6,10 +6,13 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
 #include "my_linkedlist.h"
 #include "constants.h"
+#include "numparse.h"
 
-#define CAPACITY 50000 // size of hashtable
+#define DEFAULT_CAPACITY 50000 // default size of hashtable
 
 // Forward declaration of Node
 typedef struct Node Node;
@@ -29,8 +32,8 @@ typedef struct hashtable {
     Node **overflow_buckets;
 } hashtable;
 
-unsigned long hash_function(const char *str);
-hashtable* create_table();
+unsigned long hash_function(const char *str, int size);
+hashtable* create_table(int size);
 hashtable_item* create_item(const char *key, void *value, ValueType type);
 void free_item(hashtable_item *item);
 void free_table(hashtable *table);
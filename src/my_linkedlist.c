@@ -92,7 +92,7 @@ void print_node(const Node* node) {
             printf("%s\n", (char*)node->item->value);
             break;
         case INT:
-            printf("%d\n", *(int*)node->item->value);
+            printf("%" PRId64 "\n", *(int64_t*)node->item->value);
             break;
         case FLOAT:
             printf("%f\n", *(double*)node->item->value);
@@ -122,7 +122,9 @@ void free_list(Node *head) {
 
     while (current != NULL) {
         next = current->next;
-        free(current->item);
+        if (current->item != NULL) {
+            free_item(current->item);
+        }
         free(current);
         current = next;
     }
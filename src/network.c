@@ -2,19 +2,39 @@
 // Created by pres-mleducclement on 2024-01-29.
 //
 
+// pipe2(), accept4() and pthread_timedjoin_np()
+#define _GNU_SOURCE
 #include "network.h"
 
-void startWebserver() {
-    const char resp[] = "HTTP/1.0 200 OK\r\n"
+// Response headers stop at the last header line, sendBody adds the framing headers and the blank line
+static const char respHeaders[] = "HTTP/1.0 200 OK\r\n"
                   "Server: webserver-c\r\n"
-                  "Content-type: text/html\r\n\r\n"
-                  "<html>Hello! You've reached your very own webserver!</html>\r\n";
+                  "Content-type: text/html\r\n";
+static const char respBody[] = "<html>Hello! You've reached your very own webserver!</html>\r\n";
+static const char jsonRespHeaders[] = "HTTP/1.0 %d %s\r\n"
+                  "Server: webserver-c\r\n"
+                  "Content-type: application/json\r\n";
+// Key of respBody in the compression cache
+static const char respBodyKey[] = "respBody";
+
+// Fills addr with the IPv4 address and port of address
+static bool toSockaddr(const listen_address *address, struct sockaddr_in *addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_port = htons(address->port);
+    return inet_pton(AF_INET, address->host, &addr->sin_addr) == 1;
+}
 
-    // Create the socket
-    const int socketFeed = socket(AF_INET, SOCK_STREAM, 0);
+// Creates, binds and starts listening on a socket for address
+// Returns the socket or -1 on error
+static int createListener(const listen_address *address, const config *cfg) {
+    // Create the socket, close-on-exec so it's only ever passed on explicitly during a restart
+    // Non-blocking so workers racing for the same connection don't get stuck in accept()
+    const int socketFeed = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
 
     if (socketFeed == -1) {
         perror("webserver (socket)");
+        return -1;
     }
     // Set the SO_REUSEADDR option
     const int opt = 1;
@@ -25,113 +45,934 @@ void startWebserver() {
     printf("socket created successfully\n");
     // Create the address to bind the socket to
     struct sockaddr_in host_addr;
-    int host_addrlen = sizeof(host_addr);
-    host_addr.sin_family = AF_INET;
-    host_addr.sin_port = htons(PORT);
-    host_addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    struct sockaddr_in client_addr;
-    int client_addrlen = sizeof(client_addr);
+    const int host_addrlen = sizeof(host_addr);
+
+    if (!toSockaddr(address, &host_addr)) {
+        printf("Invalid listen address : %s\n", address->host);
+        close(socketFeed);
+        return -1;
+    }
 
     // Bind the socket
     if (bind(socketFeed, (struct sockaddr *)&host_addr, host_addrlen) != 0) {
         perror("webserver (bind)");
+        close(socketFeed);
+        return -1;
     }
-    printf("socket successfully bound to address\n");
+    printf("socket successfully bound to %s:%d\n", address->host, address->port);
+
+    applyListenerOptions(socketFeed, cfg, false);
 
     // Listen for incoming connections
-    if (listen(socketFeed, SOMAXCONN) != 0) {
+    if (listen(socketFeed, cfg->backlog) != 0) {
         perror("webserver (listen)");
+        close(socketFeed);
+        return -1;
     }
     printf("server listening for connections\n");
+    return socketFeed;
+}
+
+// Waits until socketFeed is ready for events or the deadline passes
+// Returns false on timeout or error
+static bool waitForSocket(const int socketFeed, const short events, const struct timespec *deadline) {
+    struct pollfd pfd = { .fd = socketFeed, .events = events };
 
     for (;;) {
-        char buffer[BUFFER_SIZE];
-        // Accept incoming connections
-        const int newSocketFeed = accept(socketFeed, (struct sockaddr *)&host_addr, (socklen_t *)&host_addrlen);
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        const long remainingMs = (deadline->tv_sec - now.tv_sec) * 1000 + (deadline->tv_nsec - now.tv_nsec) / 1000000;
 
-        if (newSocketFeed < 0) {
-            perror("webserver (accept)");
-            continue;
+        if (remainingMs <= 0) {
+            errno = ETIMEDOUT;
+            return false;
         }
-        printf("connection accepted\n");
 
-        // Get client address
-        const int socketName = getsockname(newSocketFeed, (struct sockaddr *)&client_addr, (socklen_t *)&client_addrlen);
+        const int ready = poll(&pfd, 1, (int)remainingMs);
+
+        if (ready > 0) {
+            return true;
+        }
+        if (ready < 0 && errno != EINTR) {
+            return false;
+        }
+    }
+}
+
+// Reads what is available on the non-blocking socket, waiting for data until the deadline
+// Returns the number of bytes read (0 if the peer closed the connection) or -1 on error
+static int readWithDeadline(const int socketFeed, char *buffer, const int len, const struct timespec *deadline) {
+    for (;;) {
+        const int valread = read(socketFeed, buffer, len);
 
-        if (socketName < 0) {
-            perror("webserver (getsockname");
+        if (valread >= 0) {
+            return valread;
+        }
+        if (errno == EINTR) {
             continue;
         }
+        if ((errno != EAGAIN && errno != EWOULDBLOCK) || !waitForSocket(socketFeed, POLLIN, deadline)) {
+            return -1;
+        }
+    }
+}
+
+// Reads until len bytes have been read, the peer closes the connection or an error occurs
+// Returns the number of bytes read or -1 on error
+static int readFully(const int socketFeed, char *buffer, const int len, const struct timespec *deadline) {
+    int total = 0;
+
+    while (total < len) {
+        const int valread = readWithDeadline(socketFeed, buffer + total, len - total, deadline);
 
-        // Read from the socket
-        const int valread = read(newSocketFeed, buffer, BUFFER_SIZE);
         if (valread < 0) {
-            perror("webserver (read)");
+            return -1;
+        }
+        if (valread == 0) {
+            break;
+        }
+        total += valread;
+    }
+    return total;
+}
+
+// Writes all of buffer, waiting for room in the send buffer until the deadline
+// Returns false on error
+static bool writeFully(const int socketFeed, const char *buffer, const size_t len, const struct timespec *deadline) {
+    size_t total = 0;
+
+    while (total < len) {
+        // MSG_NOSIGNAL so a client that went away doesn't kill the process with SIGPIPE
+        const ssize_t valwrite = send(socketFeed, buffer + total, len - total, MSG_NOSIGNAL);
+
+        if (valwrite >= 0) {
+            total += valwrite;
             continue;
         }
+        if (errno == EINTR) {
+            continue;
+        }
+        if ((errno != EAGAIN && errno != EWOULDBLOCK) || !waitForSocket(socketFeed, POLLOUT, deadline)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Defines a struct for streaming compressed output straight to a socket
+typedef struct socket_sink {
+    int socketFeed;
+    const struct timespec *deadline;
+} socket_sink;
+
+static bool writeToSocket(void *ctx, const char *data, const size_t len) {
+    const socket_sink *sink = ctx;
+    return writeFully(sink->socketFeed, data, len, sink->deadline);
+}
+
+// Sends a response, compressed when the client accepts it and the body is big enough, corked so it can share packets
+// cacheKey names a body that never changes so its compressed variants are kept and reused, NULL for dynamic bodies
+static bool sendBody(const server *srv, const int socketFeed, const config *cfg, const content_encoding accepted,
+                     const char *headers, const size_t headersLen, const char *body, const size_t bodyLen,
+                     const char *cacheKey, const struct timespec *deadline) {
+    const int level = compressionLevel(cfg, bodyLen);
+    const content_encoding encoding = level > 0 ? accepted : ENCODING_IDENTITY;
+    compressed_entry *cached = NULL;
+    char *compressed = NULL;
+    size_t compressedLen = 0;
+
+    if (encoding != ENCODING_IDENTITY && cacheKey != NULL && cfg->compressCacheSize > 0) {
+        cached = compression_cache_get(srv->compressed, cacheKey, encoding, level);
+
+        // The cache takes the buffer over when it keeps it
+        if (cached == NULL && compressToBuffer(encoding, level, body, bodyLen, &compressed, &compressedLen)) {
+            cached = compression_cache_put(srv->compressed, cacheKey, encoding, level, compressed, compressedLen,
+                                           cfg->compressCacheSize);
+            compressed = cached != NULL ? NULL : compressed;
+        }
+        if (cached != NULL) {
+            compressed = cached->data;
+            compressedLen = cached->len;
+        }
+    }
+
+    // Caches can only pick the right variant if they know it depends on Accept-Encoding
+    char framing[128];
+    const char *vary = level > 0 ? "Vary: Accept-Encoding\r\n" : "";
+    int framingLen;
+
+    if (encoding == ENCODING_IDENTITY) {
+        framingLen = snprintf(framing, sizeof(framing), "%sContent-Length: %zu\r\n\r\n", vary, bodyLen);
+    } else if (compressed != NULL) {
+        framingLen = snprintf(framing, sizeof(framing), "Content-Encoding: %s\r\n%sContent-Length: %zu\r\n\r\n",
+                              encodingName(encoding), vary, compressedLen);
+    } else {
+        // The compressed length isn't known until the end, closing the connection ends the body
+        framingLen = snprintf(framing, sizeof(framing), "Content-Encoding: %s\r\n%s\r\n", encodingName(encoding), vary);
+    }
+
+    setCork(socketFeed, cfg, true);
+    bool sent = writeFully(socketFeed, headers, headersLen, deadline) &&
+                writeFully(socketFeed, framing, framingLen, deadline);
+
+    if (sent && encoding == ENCODING_IDENTITY) {
+        sent = writeFully(socketFeed, body, bodyLen, deadline);
+    } else if (sent && compressed != NULL) {
+        sent = writeFully(socketFeed, compressed, compressedLen, deadline);
+    } else if (sent) {
+        socket_sink sink = { socketFeed, deadline };
+        sent = compressStream(encoding, level, body, bodyLen, writeToSocket, &sink);
+    }
+    setCork(socketFeed, cfg, false);
+
+    if (cached != NULL) {
+        compression_cache_release(cached);
+    } else {
+        free(compressed);
+    }
+    return sent;
+}
+
+// Refills the reader's buffer once it's been consumed
+// Returns the number of buffered bytes, 0 if the peer closed the connection or -1 on error
+static int fillBody(body_reader *reader) {
+    if (reader->start < reader->end) {
+        return reader->end - reader->start;
+    }
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += reader->timeoutSec;
+
+    reader->start = 0;
+    reader->end = readWithDeadline(reader->socketFeed, reader->buffer, reader->bufferSize, &deadline);
+
+    if (reader->end < 0) {
+        reader->end = 0;
+        return -1;
+    }
+    return reader->end;
+}
+
+static int nextBodyByte(body_reader *reader) {
+    return fillBody(reader) > 0 ? (unsigned char)reader->buffer[reader->start++] : -1;
+}
+
+// Consumes a line up to and including its '\n'
+static bool skipLine(body_reader *reader) {
+    int c;
+    while ((c = nextBodyByte(reader)) >= 0 && c != '\n') {}
+    return c == '\n';
+}
+
+// Reads a chunk-size line, and the trailers after the last chunk
+static bool readChunkSize(body_reader *reader) {
+    int64_t size = 0;
+    int digits = 0;
+    int c;
+
+    while ((c = nextBodyByte(reader)) >= 0 && isxdigit(c)) {
+        size = size * 16 + (isdigit(c) ? c - '0' : tolower(c) - 'a' + 10);
+
+        if (++digits > 8) {
+            return false;
+        }
+    }
+
+    // Skip chunk extensions up to the end of the line
+    while (c >= 0 && c != '\n') {
+        c = nextBodyByte(reader);
+    }
+    if (c < 0 || digits == 0) {
+        return false;
+    }
+
+    if (size == 0) {
+        // Trailers end with an empty line
+        for (;;) {
+            c = nextBodyByte(reader);
+
+            if (c == '\r') {
+                c = nextBodyByte(reader);
+            }
+            if (c == '\n') {
+                break;
+            }
+            if (c < 0 || !skipLine(reader)) {
+                return false;
+            }
+        }
+        reader->finished = true;
+    }
+    reader->remaining = size;
+    return true;
+}
+
+// Reads up to len bytes of the body
+// Returns the number of bytes read, 0 at the end of the body or -1 on error
+static int readBody(body_reader *reader, char *out, const int len) {
+    if (reader->finished) {
+        return 0;
+    }
+    if (reader->chunked && reader->remaining == 0 && (!readChunkSize(reader) || reader->finished)) {
+        return reader->finished ? 0 : -1;
+    }
+
+    // The connection closing before the end of the body is an error
+    if (fillBody(reader) <= 0) {
+        return -1;
+    }
+    const int64_t available = reader->end - reader->start;
+    const int n = (int)(available < reader->remaining ? (available < len ? available : len)
+                                                      : (reader->remaining < len ? reader->remaining : len));
+    memcpy(out, reader->buffer + reader->start, n);
+    reader->start += n;
+    reader->remaining -= n;
+
+    if (reader->remaining == 0) {
+        if (!reader->chunked) {
+            reader->finished = true;
+        } else {
+            // Every chunk ends with CRLF
+            int c = nextBodyByte(reader);
+
+            if (c == '\r') {
+                c = nextBodyByte(reader);
+            }
+            if (c != '\n') {
+                return -1;
+            }
+        }
+    }
+    return n;
+}
+
+// Streams an NDJSON body into the document store, parsing the records on the thread pool
+static void handleIngest(const server *srv, const int newSocketFeed, const config *cfg, const char *buffer,
+                         const int valread, const char *headerEnd) {
+    const int headersLen = headerEnd - buffer + 4;
+    const char *transferEncoding = findHeader(buffer, headerEnd, "Transfer-Encoding: ");
+    const char *contentLength = findHeader(buffer, headerEnd, "Content-Length: ");
+    body_reader reader = {
+        .socketFeed = newSocketFeed,
+        .timeoutSec = cfg->requestTimeoutSec,
+        .bufferSize = cfg->bufferSize,
+        .chunked = transferEncoding != NULL && strncasecmp(transferEncoding, "chunked", strlen("chunked")) == 0
+    };
+    int status = 200;
+
+    if (!reader.chunked && (contentLength == NULL || (reader.remaining = atoll(contentLength)) <= 0)) {
+        status = 411;
+    }
+
+    // The body bytes that came with the headers are read first
+    reader.buffer = malloc(cfg->bufferSize);
+    ingest_stream *stream = status == 200 && reader.buffer != NULL
+        ? create_ingest_stream(srv->pool, srv->store, cfg)
+        : NULL;
+    char *chunk = malloc(cfg->bufferSize);
+
+    if (stream != NULL && chunk != NULL) {
+        reader.end = valread - headersLen;
+        memcpy(reader.buffer, buffer + headersLen, reader.end);
+        int len;
+
+        while ((len = readBody(&reader, chunk, cfg->bufferSize)) > 0) {
+            if (!ingest_feed(stream, chunk, len)) {
+                break;
+            }
+        }
+        if (len < 0 || !reader.finished) {
+            printf("Ingest error: body ended early or was malformed\n");
+            status = 400;
+        }
+        if (!ingest_finish(stream)) {
+            status = 400;
+        }
+        // A full store rejects records instead of evicting old ones, so the client learns they weren't kept
+        if (status == 200 && stream->rejected > 0) {
+            printf("Ingest: document store full, %d records rejected\n", stream->rejected);
+            status = 507;
+        }
+    } else if (status == 200) {
+        printf("Error allocating memory for ingest\n");
+        status = 500;
+    }
+
+    char body[128];
+    char headers[256];
+    const int bodyLen = snprintf(body, sizeof(body),
+                                 "{\"ingested\": %d, \"failed\": %d, \"rejected\": %d, \"stored\": %d}\r\n",
+                                 stream != NULL ? stream->ingested : 0, stream != NULL ? stream->failed : 0,
+                                 stream != NULL ? stream->rejected : 0, docstore_count(srv->store));
+    const int responseHeadersLen = snprintf(headers, sizeof(headers), jsonRespHeaders, status,
+                                     status == 200 ? "OK" : status == 411 ? "Length Required" :
+                                     status == 400 ? "Bad Request" : status == 507 ? "Insufficient Storage" :
+                                     "Internal Server Error");
+    printf("ingest: %s\n", body);
+
+    const content_encoding accepted = negotiateEncoding(findHeader(buffer, headerEnd, "Accept-Encoding: "));
+
+    // The body can stream for far longer than the request timeout, which only bounds each read, so the
+    // answer gets a deadline of its own
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += cfg->requestTimeoutSec;
+
+    if (!sendBody(srv, newSocketFeed, cfg, accepted, headers, responseHeadersLen, body, bodyLen, NULL, &deadline)) {
+        perror("webserver (write)");
+    }
+    if (stream != NULL) {
+        free_ingest_stream(stream);
+    }
+    free(chunk);
+    free(reader.buffer);
+}
+
+// Answers 503 to a request whose body can't be read off the loop right now
+static void sendUnavailable(const server *srv, const int socketFeed, const config *cfg, const struct timespec *deadline) {
+    static const char body[] = "{\"error\": \"too many streams, retry later\"}\r\n";
+    char headers[256];
+    const int headersLen = snprintf(headers, sizeof(headers), jsonRespHeaders, 503, "Service Unavailable");
+
+    if (!sendBody(srv, socketFeed, cfg, ENCODING_IDENTITY, headers, headersLen, body, strlen(body), NULL, deadline)) {
+        perror("webserver (write)");
+    }
+}
+
+// Runs on the job's own thread, which answers and closes the connection before handing the job back
+static void* runIngestJob(void *arg) {
+    ingest_job *job = arg;
+    handleIngest(job->loop->srv, job->socketFeed, &job->cfg, job->request, job->requestLen, job->headerEnd);
+    close(job->socketFeed);
+    atomic_fetch_sub_explicit(&job->loop->srv->streams, 1, memory_order_relaxed);
+    completion_queue_post(&job->loop->completions, &job->done);
+    return NULL;
+}
+
+// Runs on the loop that accepted the connection once the stream is over
+static void finishIngestJob(completion *done) {
+    ingest_job *job = (ingest_job *)done;
+    job->loop->pending--;
+    free(job->request);
+    free(job);
+}
+
+// Starts a detached thread that reads a request body, the loop goes back to its other connections meanwhile
+// A client can hold its thread for as long as it keeps sending, so at most maxStreams run at once and
+// run has to give its slot back when it's done reading
+// Returns false if the thread wasn't started
+static bool startStream(server *srv, const config *cfg, void *(*run)(void *), void *job) {
+    if (atomic_fetch_add_explicit(&srv->streams, 1, memory_order_relaxed) >= cfg->maxStreams) {
+        atomic_fetch_sub_explicit(&srv->streams, 1, memory_order_relaxed);
+        printf("Too many streams (%d), turning the request away\n", cfg->maxStreams);
+        return false;
+    }
+
+    // Detached since the completion is what the loop waits on, the thread keeps the loop's blocked signals
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    const int error = pthread_create(&thread, &attr, run, job);
+    pthread_attr_destroy(&attr);
+
+    if (error != 0) {
+        printf("Error starting stream thread: %s\n", strerror(error));
+        atomic_fetch_sub_explicit(&srv->streams, 1, memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+// Starts a thread that reads the stream
+// Returns false if the thread couldn't be started, the connection is then still owned by the caller
+static bool offloadIngest(event_loop *loop, const int newSocketFeed, const config *cfg, const char *buffer,
+                          const int valread, const char *headerEnd) {
+    ingest_job *job = malloc(sizeof(ingest_job));
+    char *request = malloc(valread + 1);
+
+    if (job == NULL || request == NULL) {
+        free(job);
+        free(request);
+        return false;
+    }
+    memcpy(request, buffer, valread + 1);
+    job->done.callback = finishIngestJob;
+    job->loop = loop;
+    job->socketFeed = newSocketFeed;
+    job->request = request;
+    job->requestLen = valread;
+    job->headerEnd = request + (headerEnd - buffer);
+    job->cfg = *cfg;
+
+    if (!startStream(loop->srv, cfg, runIngestJob, job)) {
+        free(request);
+        free(job);
+        return false;
+    }
+    loop->pending++;
+    return true;
+}
+
+// Parses a request body and prints it, freeing the body
+static void parseBody(char *jsonData) {
+    hashtable* table = parseJSON(jsonData);
+    free(jsonData);
+
+    if (table != NULL) {
+        print_table(table, "JSON");
+        free_table(table);
+    }
+}
+
+// Runs on the thread pool, then hands the job back to its loop
+static void runParseJob(void *arg) {
+    parse_job *job = arg;
+    parseBody(job->body);
+    job->body = NULL;
+    completion_queue_post(&job->loop->completions, &job->done);
+}
 
-        // Read headers from the socket
-        char headers[BUFFER_SIZE];
-        const char *headerEnd = strstr(buffer, "\r\n\r\n");
-        if (headerEnd == NULL) {
-            perror("webserver (readHeader)");
+// Runs on the loop that accepted the connection once the body has been parsed
+static void finishParseJob(completion *done) {
+    parse_job *job = (parse_job *)done;
+
+    // The request timeout covers the answer, not the time spent queued behind other parses
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += job->cfg.requestTimeoutSec;
+
+    if (!sendBody(job->loop->srv, job->socketFeed, &job->cfg, job->encoding, respHeaders, strlen(respHeaders),
+                  respBody, strlen(respBody), respBodyKey, &deadline)) {
+        perror("webserver (write)");
+    }
+    close(job->socketFeed);
+    job->loop->pending--;
+    free(job);
+}
+
+// Runs on the loop when the body couldn't be read, the connection is already closed
+static void dropParseJob(completion *done) {
+    parse_job *job = (parse_job *)done;
+    job->loop->pending--;
+    free(job);
+}
+
+// Runs on a thread of its own, reads the rest of the body and then parses it like any offloaded body
+static void* runBodyRead(void *arg) {
+    parse_job *job = arg;
+
+    // The whole body has to arrive within the request timeout, however slowly the client sends it
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += job->cfg.requestTimeoutSec;
+    const int missing = job->contentLength - job->received;
+    const bool complete = readFully(job->socketFeed, job->body + job->received, missing, &deadline) == missing;
+    atomic_fetch_sub_explicit(&job->loop->srv->streams, 1, memory_order_relaxed);
+
+    if (!complete) {
+        printf("Error reading request body: it ended early or timed out\n");
+        close(job->socketFeed);
+        free(job->body);
+        job->body = NULL;
+        job->done.callback = dropParseJob;
+        completion_queue_post(&job->loop->completions, &job->done);
+    } else if (job->contentLength < job->cfg.offloadThreshold ||
+               !thread_pool_submit(job->loop->srv->pool, runParseJob, job)) {
+        // Already off the loop, so a small body or a full pool is parsed right here
+        runParseJob(job);
+    }
+    return NULL;
+}
+
+// Hands the body to the thread pool, or to a stream thread when only received of its bytes have arrived
+// The loop answers once the completion comes back
+// Returns false if neither could take it, the body is then still owned by the caller
+static bool offloadParse(event_loop *loop, const int newSocketFeed, const config *cfg, const content_encoding accepted,
+                         char *jsonData, const int contentLength, const int received) {
+    parse_job *job = malloc(sizeof(parse_job));
+
+    if (job == NULL) {
+        return false;
+    }
+    job->done.callback = finishParseJob;
+    job->loop = loop;
+    job->socketFeed = newSocketFeed;
+    job->body = jsonData;
+    job->encoding = accepted;
+    job->cfg = *cfg;
+    job->contentLength = contentLength;
+    job->received = received;
+
+    // The rest of the body comes from the client, the read and then the parse happen on a stream thread
+    const bool started = received < contentLength
+        ? startStream(loop->srv, cfg, runBodyRead, job)
+        : thread_pool_submit(loop->srv->pool, runParseJob, job);
+
+    if (!started) {
+        free(job);
+        return false;
+    }
+    loop->pending++;
+    return true;
+}
+
+// Serves one request, answering it right away unless its body is handed to the thread pool or a stream thread
+// Returns true if the connection now belongs to a parse or ingest job
+static bool serveRequest(event_loop *loop, const int newSocketFeed, const config *cfg, char *buffer, const struct timespec *deadline) {
+    struct sockaddr_in client_addr;
+    int client_addrlen = sizeof(client_addr);
+
+    // Get client address
+    const int socketName = getsockname(newSocketFeed, (struct sockaddr *)&client_addr, (socklen_t *)&client_addrlen);
+
+    if (socketName < 0) {
+        perror("webserver (getsockname");
+        return false;
+    }
+
+    // Read from the socket, leaving room for a terminator so the buffer can be searched as a string
+    const int valread = readWithDeadline(newSocketFeed, buffer, cfg->bufferSize, deadline);
+    if (valread < 0) {
+        perror("webserver (read)");
+        return false;
+    }
+    buffer[valread] = '\0';
+
+    // Read the request line and headers
+    http_request request;
+
+    if (!parseRequestHead(buffer, &request)) {
+        printf("Malformed or incomplete request head\n");
+        return false;
+    }
+    const char *headerEnd = request.headerEnd;
+    const int headersLen = request.headersLen;
+    const char *method = request.method, *uri = request.uri;
+    const content_encoding accepted = negotiateEncoding(findHeader(buffer, headerEnd, "Accept-Encoding: "));
+    printf("[%s:%u] %s %s %s\n", inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port), method, request.version, uri);
+
+    // Streamed NDJSON records, the body can take as long as the client likes so it's read off the loop
+    // Reading it here instead would stall the loop, so without a thread the client is told to retry
+    if (strcmp(method, "POST") == 0 && strcmp(uri, "/ingest") == 0) {
+        if (offloadIngest(loop, newSocketFeed, cfg, buffer, valread, headerEnd)) {
+            return true;
+        }
+        sendUnavailable(loop->srv, newSocketFeed, cfg, deadline);
+        return false;
+    }
+
+    // Handle POST requests
+    if (strcmp(method, "POST") == 0) {
+        // Get the content length header, only looking inside the headers
+        const char *contentLengthValue = findHeader(buffer, headerEnd, "Content-Length: ");
+
+        if (contentLengthValue == NULL) {
+            perror("webserver (strstr)");
+            return false;
+        }
+
+        // Parse the Content-Length header
+        const int contentLength = atoi(contentLengthValue);
+
+        if (contentLength <= 0 || contentLength > cfg->maxBodySize) {
+            perror("webserver (atoi)");
+            return false;
+        }
+
+        // Read the JSON data from the client
+        char *jsonData = calloc(contentLength + 1, 1);
+
+        if (jsonData == NULL) {
+            printf("Error allocating memory for request body\n");
+            return false;
+        }
+        const int bodyInBuffer = valread - headersLen < contentLength ? valread - headersLen : contentLength;
+        memcpy(jsonData, buffer + headersLen, bodyInBuffer);
+
+        // Waiting on the rest of the body, or parsing a big one, would stall every connection on this loop
+        if (bodyInBuffer < contentLength || contentLength >= cfg->offloadThreshold) {
+            if (offloadParse(loop, newSocketFeed, cfg, accepted, jsonData, contentLength, bodyInBuffer)) {
+                return true;
+            }
+
+            // A body that's still coming can't be read here, one that already arrived is parsed inline
+            if (bodyInBuffer < contentLength) {
+                free(jsonData);
+                sendUnavailable(loop->srv, newSocketFeed, cfg, deadline);
+                return false;
+            }
+        }
+
+        // Parse the JSON data
+        parseBody(jsonData);
+    }
+
+    if (!sendBody(loop->srv, newSocketFeed, cfg, accepted, respHeaders, strlen(respHeaders), respBody, strlen(respBody),
+                  respBodyKey, deadline)) {
+        perror("webserver (write)");
+    }
+    return false;
+}
+
+static void handleConnection(event_loop *loop, const int newSocketFeed) {
+    // Settings are read once per connection so a reload applies from the next request on
+    config cfg;
+    getConfig(&cfg);
+
+    // Bound how long a single request can hold up a worker (and therefore a restart)
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += cfg.requestTimeoutSec;
+    applyConnectionOptions(newSocketFeed, &cfg);
+
+    char *buffer = malloc(cfg.bufferSize + 1);
+
+    if (buffer == NULL) {
+        printf("Error allocating memory for request buffer\n");
+    } else {
+        const bool offloaded = serveRequest(loop, newSocketFeed, &cfg, buffer, &deadline);
+        free(buffer);
+
+        if (offloaded) {
+            return;
+        }
+    }
+    close(newSocketFeed);
+}
+
+// Accepts and serves connections until the wake pipe becomes readable, answering offloaded requests as they complete
+// Returns once every offloaded request of this loop has been answered
+static void* acceptLoop(void *arg) {
+    event_loop *loop = arg;
+    const server *srv = loop->srv;
+    const int wakeIndex = srv->listenerCount;
+    const int completionIndex = srv->listenerCount + 1;
+    struct pollfd pollfds[MAX_LISTENERS + 2];
+    bool stopping = false;
+
+    for (int i = 0; i < srv->listenerCount; i++) {
+        pollfds[i].fd = srv->listeners[i];
+        pollfds[i].events = POLLIN;
+    }
+    pollfds[wakeIndex].fd = srv->wakePipe[0];
+    pollfds[wakeIndex].events = POLLIN;
+    pollfds[completionIndex].fd = loop->completions.eventFd;
+    pollfds[completionIndex].events = POLLIN;
+
+    while (!stopping || loop->pending > 0) {
+        if (poll(pollfds, srv->listenerCount + 2, -1) < 0) {
+            if (errno != EINTR) {
+                perror("webserver (poll)");
+            }
             continue;
         }
-        // Copy including the blank line -> (2 * "\r\n")
-        memcpy(headers, buffer, headerEnd - buffer + 4);
-        // Read the request
-        char method[BUFFER_SIZE], uri[BUFFER_SIZE], version[BUFFER_SIZE];
-        sscanf(buffer, "%s %s %s", method, uri, version);
-        printf("[%s:%u] %s %s %s\n", inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port), method, version, uri);
-
-        // Handle POST requests
-        if (strcmp(method, "POST") == 0) {
-            // Get the content length header
-            char contentLenghtHeader[BUFFER_SIZE];
-            const char *contentLengthLine = strstr(headers, "Content-Length: ");
-
-            if (contentLengthLine == NULL) {
-                perror("webserver (strstr)");
+
+        if (pollfds[completionIndex].revents) {
+            completion_queue_drain(&loop->completions);
+        }
+
+        // Stop accepting, the process is shutting down
+        // Negative fds are ignored by poll, the loop only waits for its pending completions from now on
+        if (pollfds[wakeIndex].revents) {
+            stopping = true;
+
+            for (int i = 0; i <= wakeIndex; i++) {
+                pollfds[i].fd = -1;
+            }
+            continue;
+        }
+
+        for (int i = 0; i < srv->listenerCount; i++) {
+            if (!(pollfds[i].revents & POLLIN)) {
                 continue;
             }
-            sscanf(contentLengthLine, "Content-Length: %s", contentLenghtHeader);
+            struct sockaddr_in host_addr;
+            int host_addrlen = sizeof(host_addr);
 
-            // Parse the Content-Length header
-            const int contentLength = atoi(contentLenghtHeader);
+            // Accept incoming connections
+            const int newSocketFeed = accept4(srv->listeners[i], (struct sockaddr *)&host_addr, (socklen_t *)&host_addrlen,
+                                              SOCK_NONBLOCK | SOCK_CLOEXEC);
 
-            if (contentLength <= 0 || contentLength > BUFFER_SIZE) {
-                perror("webserver (atoi)");
+            if (newSocketFeed < 0) {
+                // Another worker got to it first
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    perror("webserver (accept)");
+                }
                 continue;
             }
+            printf("connection accepted\n");
+            handleConnection(loop, newSocketFeed);
+        }
+    }
+    return NULL;
+}
 
-            // Read the JSON data from the client
-            char jsonData[BUFFER_SIZE] = {0};
-            const int remainingData = contentLength - (valread - (headerEnd - buffer + 4));
+// Waits for the workers to finish their in-flight requests, giving up after the drain timeout
+// Returns false if some worker was still busy at the deadline
+static bool drainWorkers(const event_loop *loops, const int workerCount, const int drainTimeoutSec) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += drainTimeoutSec;
 
-            if (remainingData > 0) {
-                memcpy(jsonData, headerEnd + 4, contentLength - remainingData);
-                const int jsonDataLen = read(newSocketFeed, jsonData + contentLength - remainingData, remainingData);
+    for (int i = 0; i < workerCount; i++) {
+        if (pthread_timedjoin_np(loops[i].thread, NULL, &deadline) != 0) {
+            printf("drain timeout reached, dropping in-flight connections\n");
+            return false;
+        }
+    }
+    printf("old process drained, exiting\n");
+    return true;
+}
 
-                if (jsonDataLen < 0) {
-                    perror("webserver (read)");
-                    continue;
-                }
+// Takes over the sockets of the process we're replacing for the addresses that are still configured
+// Inherited sockets for addresses no longer configured are closed, new addresses get a socket of their own,
+// and the kept ones get the current backlog and options
+static void adoptListeners(server *srv, int *inherited, const int inheritedCount, const config *cfg) {
+    bool kept[MAX_LISTENERS] = { false };
+    bool found[MAX_LISTENERS] = { false };
+
+    for (int i = 0; i < cfg->listenCount; i++) {
+        struct sockaddr_in wanted;
+
+        if (!toSockaddr(&cfg->listen[i], &wanted)) {
+            continue;
+        }
+        for (int j = 0; j < inheritedCount && !found[i]; j++) {
+            struct sockaddr_in bound;
+            socklen_t boundLen = sizeof(bound);
+
+            if (kept[j] || getsockname(inherited[j], (struct sockaddr *)&bound, &boundLen) != 0 ||
+                bound.sin_family != AF_INET || bound.sin_port != wanted.sin_port ||
+                bound.sin_addr.s_addr != wanted.sin_addr.s_addr) {
+                continue;
             }
-            else {
-                memcpy(jsonData, headerEnd + 4, contentLength);
+            kept[j] = true;
+            found[i] = true;
+            applyListenerOptions(inherited[j], cfg, true);
+
+            // listen() again only updates the backlog, queued connections stay
+            if (listen(inherited[j], cfg->backlog) != 0) {
+                perror("webserver (listen)");
             }
+            srv->listeners[srv->listenerCount++] = inherited[j];
+        }
+    }
 
-            // Parse the JSON data
-            hashtable* table = parseJSON(jsonData);
-            print_table(table, "JSON");
-            free_table(table);
+    // Closed first so an address moving to another interface on the same port can be bound again
+    for (int j = 0; j < inheritedCount; j++) {
+        if (!kept[j]) {
+            printf("closing inherited socket no longer in the config\n");
+            close(inherited[j]);
         }
+    }
+
+    for (int i = 0; i < cfg->listenCount; i++) {
+        if (!found[i]) {
+            const int listener = createListener(&cfg->listen[i], cfg);
+
+            if (listener >= 0) {
+                srv->listeners[srv->listenerCount++] = listener;
+            }
+        }
+    }
+}
 
-        const int valwrite = write(newSocketFeed, resp, strlen(resp));
-        if (valwrite < 0) {
-            perror("webserver (write)");
+void startWebserver(char **argv) {
+    server srv;
+    config cfg;
+    getConfig(&cfg);
+    installRestartHandlers();
+
+    // Either take over the sockets of the process we're replacing or create our own
+    int inherited[MAX_LISTENERS];
+    const int inheritedCount = receiveListeners(inherited, MAX_LISTENERS);
+    srv.listenerCount = 0;
+    atomic_init(&srv.streams, 0);
+    adoptListeners(&srv, inherited, inheritedCount > 0 ? inheritedCount : 0, &cfg);
+
+    if (srv.listenerCount == 0) {
+        printf("No socket to listen on, exiting\n");
+        return;
+    }
+
+    if (pipe2(srv.wakePipe, O_CLOEXEC) != 0) {
+        perror("webserver (pipe)");
+        return;
+    }
+
+    // Workers inherit a mask with the restart/reload signals blocked so they're always handled here
+    sigset_t signals, previous;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGHUP);
+    sigaddset(&signals, SIGUSR2);
+    pthread_sigmask(SIG_BLOCK, &signals, &previous);
+
+    srv.pool = create_thread_pool(cfg.poolWorkers);
+    srv.store = create_docstore();
+    srv.compressed = create_compression_cache();
+
+    if (srv.pool == NULL || srv.store == NULL || srv.compressed == NULL) {
+        printf("Could not start the thread pool, exiting\n");
+        return;
+    }
+    printf("%d pool worker(s) started\n", srv.pool->workerCount);
+
+    event_loop *loops = calloc(cfg.workers, sizeof(event_loop));
+    int workerCount = 0;
+
+    for (int i = 0; loops != NULL && i < cfg.workers; i++) {
+        event_loop *loop = &loops[workerCount];
+        loop->srv = &srv;
+
+        if (!init_completion_queue(&loop->completions)) {
+            continue;
+        }
+        if (pthread_create(&loop->thread, NULL, acceptLoop, loop) != 0) {
+            perror("webserver (pthread_create)");
+            close_completion_queue(&loop->completions);
             continue;
         }
-        close(newSocketFeed);
+        workerCount++;
+    }
+
+    if (workerCount == 0) {
+        printf("No worker could be started, exiting\n");
+        free(loops);
+        return;
+    }
+    printf("%d worker(s) started\n", workerCount);
+
+    for (;;) {
+        if (reloadRequested) {
+            reloadRequested = 0;
+            printf("reload requested\n");
+            reloadConfig();
+        }
+
+        if (restartRequested) {
+            restartRequested = 0;
+            printf("restart requested\n");
+            getConfig(&cfg);
+
+            if (handOffListeners(srv.listeners, srv.listenerCount, cfg.handoffTimeoutSec, argv)) {
+                break;
+            }
+        }
+        // Atomically unblocks the signals and waits for one
+        sigsuspend(&previous);
+    }
+
+    // The new process owns the queue now: stop accepting and let in-flight requests finish
+    if (write(srv.wakePipe[1], "", 1) != 1) {
+        perror("webserver (write wake pipe)");
+    }
+    // Offloaded requests still reference their loop, only free the loops once they've all returned
+    // and the threads that posted their completions are out of the queues
+    if (drainWorkers(loops, workerCount, cfg.drainTimeoutSec)) {
+        for (int i = 0; i < workerCount; i++) {
+            close_completion_queue(&loops[i].completions);
+        }
+        free(loops);
     }
 }
\ No newline at end of file
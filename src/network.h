@@ -9,14 +9,86 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <poll.h>
+#include <sys/time.h>
+#include <time.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <unistd.h>
 #include <arpa/inet.h>
+#include "completion_queue.h"
+#include "compression.h"
+#include "config.h"
+#include "docstore.h"
+#include "http.h"
+#include "ingest.h"
 #include "constants.h"
 #include "toolbox.h"
 #include "my_hashtable.h"
+#include "restart.h"
+#include "socket_options.h"
+#include "thread_pool.h"
 
-void startWebserver();
+// Defines a struct for the state shared by the accept loop workers
+typedef struct server {
+    int listeners[MAX_LISTENERS];
+    int listenerCount;
+    int wakePipe[2];    // Becomes readable when the workers should stop accepting
+    thread_pool *pool;  // Background threads for CPU-heavy work
+    docstore *store;
+    compression_cache *compressed;  // Compressed variants of the static responses
+    atomic_int streams;             // Request bodies being read on threads of their own, capped by maxStreams
+} server;
+
+// Defines a struct for the state of one I/O thread
+// The thread polls the listeners and its completion queue, CPU-heavy requests are parsed on the pool meanwhile
+typedef struct event_loop {
+    server *srv;
+    pthread_t thread;
+    completion_queue completions;   // Offloaded requests that are ready to be answered
+    int pending;                    // Offloaded requests and ingest streams not finished yet, only touched by the loop's thread
+} event_loop;
+
+// Defines a struct for a request body parsed on the thread pool, after a stream thread read it if it wasn't all there
+typedef struct parse_job {
+    completion done;    // First member so the completion can be cast back to the job
+    event_loop *loop;   // Loop that answers the request once the body is parsed
+    int socketFeed;
+    char *body;
+    int contentLength;
+    int received;       // Body bytes that came with the head, the stream thread reads the rest
+    content_encoding encoding;  // Accepted by the client
+    config cfg;
+} parse_job;
+
+// Defines a struct for an NDJSON stream read on a thread of its own so it can't hold up its loop
+typedef struct ingest_job {
+    completion done;    // First member so the completion can be cast back to the job
+    event_loop *loop;   // Loop that accepted the connection, it waits for the job before exiting
+    int socketFeed;
+    char *request;      // Copy of what the loop read, the head and the first body bytes
+    int requestLen;
+    const char *headerEnd;
+    config cfg;
+} ingest_job;
+
+// Defines a struct for reading a request body, either Content-Length delimited or chunked
+typedef struct body_reader {
+    int socketFeed;
+    int timeoutSec;     // Idle timeout, restarted after every read so long streams aren't cut off
+    char *buffer;
+    int bufferSize;
+    int start;
+    int end;
+    bool chunked;
+    int64_t remaining;  // Bytes left in the body, or in the current chunk when chunked
+    bool finished;
+} body_reader;
+
+void startWebserver(char **argv);
 
 #endif //NETWORK_H
@@ -0,0 +1,357 @@
+#include "numparse.h"
+#include "numparse_table.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Largest integer a double can represent exactly
+#define MAX_EXACT_MANTISSA (1ULL << 53)
+// Largest power of ten a double can represent exactly
+#define MAX_EXACT_POW10 22
+// Number of decimal digits that always fit in an uint64_t
+#define MAX_MANTISSA_DIGITS 19
+// Inputs longer than this are copied to the heap before calling strtod()
+#define STACK_COPY_SIZE 64
+
+static const double pow10_table[MAX_EXACT_POW10 + 1] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static inline bool is_digit(const char c) {
+    return (unsigned char)(c - '0') < 10;
+}
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define HAVE_SWAR_DIGITS 1
+
+// Loads 8 characters into a register, first character in the low byte
+static inline uint64_t load_eight(const char *str) {
+    uint64_t val;
+    memcpy(&val, str, sizeof(val));
+    return val;
+}
+
+// Checks if all 8 bytes of val are ASCII digits without branching on each byte
+static inline bool is_eight_digits(const uint64_t val) {
+    return ((val & 0xF0F0F0F0F0F0F0F0ULL) |
+            (((val + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) == 0x3333333333333333ULL;
+}
+
+// Converts 8 ASCII digits to their value with three multiplications
+static inline uint32_t parse_eight_digits(uint64_t val) {
+    const uint64_t mask = 0x000000FF000000FFULL;
+    const uint64_t mul1 = 0x000F424000000064ULL; // 100 + (1000000 << 32)
+    const uint64_t mul2 = 0x0000271000000001ULL; // 1 + (10000 << 32)
+
+    val -= 0x3030303030303030ULL;
+    val = (val * 10) + (val >> 8);
+    val = (((val & mask) * mul1) + (((val >> 16) & mask) * mul2)) >> 32;
+    return (uint32_t)val;
+}
+#endif
+
+// Accumulates a run of digits into mantissa
+// digits counts the significant digits seen so far; once it exceeds MAX_MANTISSA_DIGITS
+// the mantissa is no longer exact and callers must not trust it
+static size_t accumulate_digits(const char *str, const size_t len, uint64_t *mantissa, int *digits) {
+    uint64_t m = *mantissa;
+    int d = *digits;
+    size_t i = 0;
+
+#ifdef HAVE_SWAR_DIGITS
+    // Leading zeros are counted here too, which only makes the fast path more conservative
+    while (i + 8 <= len && d + 8 <= MAX_MANTISSA_DIGITS) {
+        const uint64_t chunk = load_eight(str + i);
+        if (!is_eight_digits(chunk)) {
+            break;
+        }
+        m = m * 100000000 + parse_eight_digits(chunk);
+        d += 8;
+        i += 8;
+    }
+#endif
+
+    for (; i < len && is_digit(str[i]); i++) {
+        const unsigned digit = str[i] - '0';
+
+        // Leading zeros are not significant
+        if (m == 0 && digit == 0) {
+            continue;
+        }
+        if (d < MAX_MANTISSA_DIGITS) {
+            m = m * 10 + digit;
+        }
+        d++;
+    }
+    *mantissa = m;
+    *digits = d;
+    return i;
+}
+
+// Slow path for inputs the fast path can't round exactly
+static bool parse_double_fallback(const char *str, const size_t len, double *out) {
+    char stackCopy[STACK_COPY_SIZE];
+    char *copy = len < sizeof(stackCopy) ? stackCopy : malloc(len + 1);
+
+    if (copy == NULL) {
+        printf("Error allocating memory for number\n");
+        return false;
+    }
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    *out = strtod(copy, NULL);
+
+    if (copy != stackCopy) {
+        free(copy);
+    }
+    return true;
+}
+
+size_t scanNumber(const char *str, const size_t len, ValueType *type) {
+    size_t i = 0;
+    *type = INT;
+
+    if (i < len && str[i] == '-') {
+        i++;
+    }
+    if (i >= len || !is_digit(str[i])) {
+        return 0;
+    }
+
+    // JSON does not allow leading zeros
+    if (str[i] == '0') {
+        i++;
+    } else {
+        while (i < len && is_digit(str[i])) {
+            i++;
+        }
+    }
+
+    // Fraction
+    if (i + 1 < len && str[i] == '.' && is_digit(str[i + 1])) {
+        *type = FLOAT;
+        i += 2;
+        while (i < len && is_digit(str[i])) {
+            i++;
+        }
+    }
+
+    // Exponent
+    if (i < len && (str[i] == 'e' || str[i] == 'E')) {
+        size_t j = i + 1;
+
+        if (j < len && (str[j] == '+' || str[j] == '-')) {
+            j++;
+        }
+        if (j < len && is_digit(str[j])) {
+            *type = FLOAT;
+            while (j < len && is_digit(str[j])) {
+                j++;
+            }
+            i = j;
+        }
+    }
+    return i;
+}
+
+bool parseInt64(const char *str, const size_t len, int64_t *out) {
+    size_t i = 0;
+    const bool negative = len > 0 && str[0] == '-';
+
+    if (negative) {
+        i++;
+    }
+    if (i >= len || (str[i] == '0' && len - i > 1)) {
+        return false;
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    i += accumulate_digits(str + i, len - i, &mantissa, &digits);
+
+    if (i != len || digits > MAX_MANTISSA_DIGITS) {
+        return false;
+    }
+    if (mantissa > (negative ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX)) {
+        return false;
+    }
+
+    if (negative) {
+        *out = mantissa == 0 ? 0 : -(int64_t)(mantissa - 1) - 1;
+    } else {
+        *out = (int64_t)mantissa;
+    }
+    return true;
+}
+
+// Full 64 x 64 -> 128 bit product
+static inline void multiply_u64(const uint64_t a, const uint64_t b, uint64_t *high, uint64_t *low) {
+#ifdef __SIZEOF_INT128__
+    const unsigned __int128 product = (unsigned __int128)a * b;
+    *high = (uint64_t)(product >> 64);
+    *low = (uint64_t)product;
+#else
+    const uint64_t aLow = (uint32_t)a, aHigh = a >> 32, bLow = (uint32_t)b, bHigh = b >> 32;
+    const uint64_t lowLow = aLow * bLow, highLow = aHigh * bLow, lowHigh = aLow * bHigh;
+    const uint64_t middle = (lowLow >> 32) + (uint32_t)highLow + (uint32_t)lowHigh;
+    *high = aHigh * bHigh + (highLow >> 32) + (lowHigh >> 32) + (middle >> 32);
+    *low = (middle << 32) | (uint32_t)lowLow;
+#endif
+}
+
+static inline int leading_zeros(const uint64_t val) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_clzll(val);
+#else
+    int count = 0;
+    for (uint64_t bit = 1ULL << 63; (val & bit) == 0; bit >>= 1) {
+        count++;
+    }
+    return count;
+#endif
+}
+
+// Eisel-Lemire: rounds mantissa * 10^exponent from the 192-bit product of the mantissa and the truncated 5^exponent
+// The truncation only ever makes the product smaller by less than one unit of its low 64 bits, so the result is
+// exact unless that error could carry into the rounded bits or the product sits on a halfway point
+// Returns false in those rare cases and for results that aren't normal doubles, mantissa must not be 0
+static bool eisel_lemire(uint64_t mantissa, const int64_t exponent, const bool negative, double *out) {
+    if (exponent < POW5_TABLE_MIN || exponent > POW5_TABLE_MAX) {
+        return false;
+    }
+    const int shift = leading_zeros(mantissa);
+    mantissa <<= shift;
+
+    const uint64_t *pow5 = pow5_table[exponent - POW5_TABLE_MIN];
+    uint64_t high, middle, low, lowCarry;
+    multiply_u64(mantissa, pow5[0], &high, &middle);
+    multiply_u64(mantissa, pow5[1], &lowCarry, &low);
+    middle += lowCarry;
+    high += middle < lowCarry;
+
+    // The missing part of the product is below mantissa, it can only reach high through an all ones middle
+    if (middle == UINT64_MAX && low + mantissa < low) {
+        return false;
+    }
+
+    // 53 bits plus one rounding bit, high has at most one leading zero since both factors have their top bit set
+    const int upperBit = (int)(high >> 63);
+    const int dropped = 9 + upperBit;
+    uint64_t bits = high >> dropped;
+
+    // A rounding bit with nothing below it may be an exact halfway point that strtod() has to settle
+    if ((bits & 1) && (high & ((1ULL << dropped) - 1)) == 0 && middle == 0 && low == 0) {
+        return false;
+    }
+
+    // floor(log2(5^exponent)) is (152170 * exponent) >> 16 over the whole table
+    int64_t biasedExponent = 1086 + upperBit + exponent - shift + ((152170 * exponent) >> 16);
+    bits = (bits + (bits & 1)) >> 1;
+
+    if (bits == 1ULL << 53) {
+        bits >>= 1;
+        biasedExponent++;
+    }
+    // Subnormals and overflows are left to strtod()
+    if (biasedExponent <= 0 || biasedExponent >= 2047) {
+        return false;
+    }
+
+    bits = (bits & ((1ULL << 52) - 1)) | ((uint64_t)biasedExponent << 52) | ((uint64_t)negative << 63);
+    memcpy(out, &bits, sizeof(bits));
+    return true;
+}
+
+bool parseDouble(const char *str, const size_t len, double *out) {
+    size_t i = 0;
+    const bool negative = len > 0 && str[0] == '-';
+
+    if (negative) {
+        i++;
+    }
+    // JSON does not allow leading zeros
+    if (i >= len || !is_digit(str[i]) || (str[i] == '0' && i + 1 < len && is_digit(str[i + 1]))) {
+        return false;
+    }
+
+    // The grammar is checked while parsing so valid input is only read once
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int64_t exponent = 0;
+    i += accumulate_digits(str + i, len - i, &mantissa, &digits);
+
+    if (i < len && str[i] == '.') {
+        i++;
+        const size_t fractionLen = accumulate_digits(str + i, len - i, &mantissa, &digits);
+
+        if (fractionLen == 0) {
+            return false;
+        }
+        exponent -= (int64_t)fractionLen;
+        i += fractionLen;
+    }
+
+    if (i < len && (str[i] == 'e' || str[i] == 'E')) {
+        i++;
+        const bool negativeExponent = i < len && str[i] == '-';
+
+        if (i < len && (str[i] == '-' || str[i] == '+')) {
+            i++;
+        }
+        if (i >= len || !is_digit(str[i])) {
+            return false;
+        }
+        int64_t explicitExponent = 0;
+
+        for (; i < len && is_digit(str[i]); i++) {
+            // Anything this large over/underflows anyway, let strtod() decide
+            if (explicitExponent < 100000) {
+                explicitExponent = explicitExponent * 10 + (str[i] - '0');
+            }
+        }
+        exponent += negativeExponent ? -explicitExponent : explicitExponent;
+    }
+
+    if (i != len) {
+        return false;
+    }
+    if (mantissa == 0 && digits <= MAX_MANTISSA_DIGITS) {
+        *out = negative ? -0.0 : 0.0;
+        return true;
+    }
+
+    if (digits <= MAX_MANTISSA_DIGITS) {
+        // Clinger's fast path: an exact mantissa times an exact power of ten rounds correctly
+        if (mantissa <= MAX_EXACT_MANTISSA) {
+            // Move surplus exponent into the mantissa while it stays exact, e.g. 12e25 -> 12000e22
+            while (exponent > MAX_EXACT_POW10 && mantissa <= MAX_EXACT_MANTISSA / 10) {
+                mantissa *= 10;
+                exponent--;
+            }
+
+            if (exponent >= -MAX_EXACT_POW10 && exponent <= MAX_EXACT_POW10) {
+                double value = (double)mantissa;
+                value = exponent < 0 ? value / pow10_table[-exponent] : value * pow10_table[exponent];
+                *out = negative ? -value : value;
+                return true;
+            }
+        }
+        if (eisel_lemire(mantissa, exponent, negative, out)) {
+            return true;
+        }
+    } else {
+        // Only the first digits made it into the mantissa, the value lies between mantissa and mantissa + 1
+        // at the exponent of the last kept digit. When both ends round to the same double so does the value
+        const int64_t keptExponent = exponent + (digits - MAX_MANTISSA_DIGITS);
+        double lower, upper;
+
+        if (eisel_lemire(mantissa, keptExponent, negative, &lower) &&
+            eisel_lemire(mantissa + 1, keptExponent, negative, &upper) && lower == upper) {
+            *out = lower;
+            return true;
+        }
+    }
+    return parse_double_fallback(str, len, out);
+}
@@ -0,0 +1,22 @@
+#ifndef NUMPARSE_H
+#define NUMPARSE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "constants.h"
+
+// Scans the longest valid JSON number at the start of str
+// Returns the number of characters consumed (0 if str does not start with a number)
+// and sets type to INT or FLOAT
+size_t scanNumber(const char *str, size_t len, ValueType *type);
+
+// Parses exactly len characters of str as a JSON integer
+// Returns false if the input is not an integer or does not fit in an int64_t
+bool parseInt64(const char *str, size_t len, int64_t *out);
+
+// Parses exactly len characters of str as a JSON number
+// Returns false if the input is not a number. The result is correctly rounded
+bool parseDouble(const char *str, size_t len, double *out);
+
+#endif //NUMPARSE_H
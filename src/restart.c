@@ -0,0 +1,248 @@
+#include "restart.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+volatile sig_atomic_t restartRequested = 0;
+volatile sig_atomic_t reloadRequested = 0;
+
+static void handle_restart_signal(const int signal) {
+    if (signal == SIGHUP) {
+        reloadRequested = 1;
+    } else {
+        restartRequested = 1;
+    }
+}
+
+void installRestartHandlers() {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_restart_signal;
+    sigemptyset(&action.sa_mask);
+    // Interrupted reads and writes are restarted so in-flight requests aren't cut short
+    action.sa_flags = SA_RESTART;
+
+    if (sigaction(SIGHUP, &action, NULL) != 0 || sigaction(SIGUSR2, &action, NULL) != 0) {
+        perror("webserver (sigaction)");
+    }
+}
+
+// Receives the listening sockets of the process that exec'd us
+// Returns the number of fds received, 0 if this is a cold start and -1 on error
+int receiveListeners(int *fds, const int maxFds) {
+    const char *channelEnv = getenv(HANDOFF_ENV);
+
+    if (channelEnv == NULL) {
+        return 0;
+    }
+    const int channel = atoi(channelEnv);
+    unsetenv(HANDOFF_ENV);
+
+    int count = 0;
+    char control[CMSG_SPACE(sizeof(int) * MAX_LISTENERS)];
+    struct iovec iov = { .iov_base = &count, .iov_len = sizeof(count) };
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control,
+        .msg_controllen = sizeof(control)
+    };
+
+    if (recvmsg(channel, &msg, MSG_CMSG_CLOEXEC) != sizeof(count)) {
+        perror("webserver (recvmsg)");
+        close(channel);
+        return -1;
+    }
+
+    const struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+
+    if (cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ||
+        count <= 0 || count > maxFds || cmsg->cmsg_len != CMSG_LEN(sizeof(int) * count)) {
+        printf("Invalid listener handoff message\n");
+        close(channel);
+        return -1;
+    }
+    memcpy(fds, CMSG_DATA(cmsg), sizeof(int) * count);
+
+    // Tell the old process it can stop accepting
+    const char ack = 1;
+
+    if (write(channel, &ack, sizeof(ack)) != sizeof(ack)) {
+        perror("webserver (write ack)");
+    }
+    close(channel);
+    printf("received %d listening socket(s) from previous process\n", count);
+    return count;
+}
+
+static bool send_listeners(const int channel, const int *fds, int count) {
+    char control[CMSG_SPACE(sizeof(int) * MAX_LISTENERS)];
+    memset(control, 0, sizeof(control));
+    struct iovec iov = { .iov_base = &count, .iov_len = sizeof(count) };
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control,
+        .msg_controllen = CMSG_SPACE(sizeof(int) * count)
+    };
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * count);
+
+    // MSG_NOSIGNAL so a child that failed to exec doesn't take this process down with SIGPIPE
+    if (sendmsg(channel, &msg, MSG_NOSIGNAL) != sizeof(count)) {
+        perror("webserver (sendmsg)");
+        return false;
+    }
+    return true;
+}
+
+static bool wait_for_ack(const int channel, const int timeoutSec) {
+    struct pollfd pfd = { .fd = channel, .events = POLLIN };
+    int ready;
+
+    do {
+        ready = poll(&pfd, 1, timeoutSec * 1000);
+    } while (ready < 0 && errno == EINTR);
+
+    if (ready <= 0) {
+        printf("Timed out waiting for the new process\n");
+        return false;
+    }
+
+    char ack = 0;
+    return read(channel, &ack, sizeof(ack)) == sizeof(ack) && ack == 1;
+}
+
+// Finds the file execvp() would run for name, searching PATH when name has no slash
+static bool resolve_executable(const char *name, char *path, const size_t size) {
+    if (strchr(name, '/') != NULL) {
+        return snprintf(path, size, "%s", name) < (int)size;
+    }
+    const char *dirs = getenv("PATH");
+
+    if (dirs == NULL) {
+        dirs = "/usr/bin:/bin";
+    }
+
+    while (*dirs != '\0') {
+        const char *end = strchr(dirs, ':');
+        const int dirLen = end != NULL ? (int)(end - dirs) : (int)strlen(dirs);
+
+        // An empty entry means the current directory
+        if (snprintf(path, size, "%.*s%s%s", dirLen, dirs, dirLen > 0 ? "/" : "", name) < (int)size &&
+            access(path, X_OK) == 0) {
+            return true;
+        }
+        dirs += dirLen;
+
+        if (*dirs == ':') {
+            dirs++;
+        }
+    }
+    printf("Error finding %s in PATH\n", name);
+    return false;
+}
+
+// Copies the environment with HANDOFF_ENV pointing at channelFd, the strings are shared with environ
+// Returns NULL on error, the caller frees the array and *handoffVar
+static char** build_handoff_env(const int channelFd, char **handoffVar) {
+    extern char **environ;
+    size_t count = 0;
+
+    while (environ[count] != NULL) {
+        count++;
+    }
+    char **envp = malloc((count + 2) * sizeof(char *));
+    *handoffVar = malloc(sizeof(HANDOFF_ENV) + 16);
+
+    if (envp == NULL || *handoffVar == NULL) {
+        printf("Error allocating memory for the handoff environment\n");
+        free(envp);
+        free(*handoffVar);
+        return NULL;
+    }
+    snprintf(*handoffVar, sizeof(HANDOFF_ENV) + 16, "%s=%d", HANDOFF_ENV, channelFd);
+    size_t used = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        if (strncmp(environ[i], HANDOFF_ENV "=", sizeof(HANDOFF_ENV)) != 0) {
+            envp[used++] = environ[i];
+        }
+    }
+    envp[used++] = *handoffVar;
+    envp[used] = NULL;
+    return envp;
+}
+
+// Starts a new copy of the binary and passes it our listening sockets over a Unix socket
+// Returns true once the new process has taken over and this one should stop accepting
+bool handOffListeners(const int *fds, const int count, const int timeoutSec, char **argv) {
+    if (count <= 0 || count > MAX_LISTENERS) {
+        return false;
+    }
+
+    int channel[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, channel) != 0) {
+        perror("webserver (socketpair)");
+        return false;
+    }
+
+    // The child of a multi-threaded process may only make async-signal-safe calls before exec,
+    // so everything it needs is prepared here
+    char path[PATH_MAX];
+    char *handoffVar = NULL;
+    char **envp = resolve_executable(argv[0], path, sizeof(path)) ? build_handoff_env(channel[1], &handoffVar) : NULL;
+    sigset_t none;
+    sigemptyset(&none);
+    const pid_t pid = envp != NULL ? fork() : -1;
+
+    if (pid < 0) {
+        if (envp != NULL) {
+            perror("webserver (fork)");
+        }
+        free(envp);
+        free(handoffVar);
+        close(channel[0]);
+        close(channel[1]);
+        return false;
+    }
+
+    if (pid == 0) {
+        // Only the child's end of the channel survives the exec, listeners are passed explicitly
+        // The signal mask survives exec too, so clear the one the accept loop runs with
+        sigprocmask(SIG_SETMASK, &none, NULL);
+        fcntl(channel[1], F_SETFD, 0);
+        execve(path, argv, envp);
+        // The parent sees the channel close and reports the failed handoff
+        _exit(127);
+    }
+    free(envp);
+    free(handoffVar);
+    close(channel[1]);
+
+    const bool handedOff = send_listeners(channel[0], fds, count) && wait_for_ack(channel[0], timeoutSec);
+    close(channel[0]);
+
+    if (!handedOff) {
+        // Keep serving from this process rather than running two half-started servers
+        printf("Listener handoff failed, still serving from pid %d\n", getpid());
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+        return false;
+    }
+    printf("listening sockets handed off to pid %d\n", pid);
+    return true;
+}
@@ -0,0 +1,19 @@
+#ifndef RESTART_H
+#define RESTART_H
+
+#include <stdbool.h>
+#include <signal.h>
+#include "constants.h"
+
+// Environment variable telling a freshly exec'd process which fd to receive its listeners from
+#define HANDOFF_ENV "WEBSERVER_HANDOFF_FD"
+
+// Set by SIGUSR2 (hand off to a new process) and SIGHUP (reload the configuration)
+extern volatile sig_atomic_t restartRequested;
+extern volatile sig_atomic_t reloadRequested;
+
+void installRestartHandlers();
+int receiveListeners(int *fds, int maxFds);
+bool handOffListeners(const int *fds, int count, int timeoutSec, char **argv);
+
+#endif //RESTART_H
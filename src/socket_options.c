@@ -0,0 +1,91 @@
+#include "socket_options.h"
+
+#include <stdio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+// Sets an int socket option, reporting failures without giving up on the socket
+static void set_option(const int socketFeed, const int level, const int name, const int value, const char *label) {
+    if (setsockopt(socketFeed, level, name, &value, sizeof(value)) != 0) {
+        perror(label);
+    }
+}
+
+// Reads the default TCP buffer size from the middle of a "min default max" sysctl
+// Returns the value to pass to setsockopt(), which doubles it, or 0 if it can't be read
+static int default_buffer_size(const char *sysctl) {
+    FILE *file = fopen(sysctl, "r");
+    int min = 0, value = 0;
+
+    if (file == NULL) {
+        return 0;
+    }
+    if (fscanf(file, "%d %d", &min, &value) != 2) {
+        value = 0;
+    }
+    fclose(file);
+    return value / 2;
+}
+
+// Sets a buffer size, 0 meaning the size a new TCP socket starts with
+// The kernel has no way to hand the size back to autotuning, so an inherited listener keeps a fixed one
+static void set_buffer_option(const int socketFeed, const int name, const int value, const char *sysctl,
+                              const char *label) {
+    const int size = value > 0 ? value : default_buffer_size(sysctl);
+
+    if (size > 0) {
+        set_option(socketFeed, SOL_SOCKET, name, size, label);
+    }
+}
+
+// Options that only make sense on a listening socket
+// Sockets received during a restart are inherited, they may carry options the new settings turn off,
+// so every option is set on them, including the ones that are 0
+void applyListenerOptions(const int socketFeed, const config *cfg, const bool inherited) {
+    // Only wake up accept() once the request bytes have arrived
+    if (cfg->deferAcceptSec > 0 || inherited) {
+        set_option(socketFeed, IPPROTO_TCP, TCP_DEFER_ACCEPT, cfg->deferAcceptSec, "webserver (TCP_DEFER_ACCEPT)");
+    }
+
+    // Let clients send the request in the SYN, a queue of 0 turns it off
+    if (cfg->fastOpenQueue > 0 || inherited) {
+        set_option(socketFeed, IPPROTO_TCP, TCP_FASTOPEN, cfg->fastOpenQueue, "webserver (TCP_FASTOPEN)");
+    }
+
+    // Set on the listener so accepted sockets inherit them before the window is negotiated
+    // A fresh listener is left alone at 0 so the kernel keeps autotuning its buffers
+    if (cfg->rcvBuf > 0 || inherited) {
+        set_buffer_option(socketFeed, SO_RCVBUF, cfg->rcvBuf, "/proc/sys/net/ipv4/tcp_rmem", "webserver (SO_RCVBUF)");
+    }
+    if (cfg->sndBuf > 0 || inherited) {
+        set_buffer_option(socketFeed, SO_SNDBUF, cfg->sndBuf, "/proc/sys/net/ipv4/tcp_wmem", "webserver (SO_SNDBUF)");
+    }
+}
+
+// Options for a freshly accepted socket, read from the settings in effect for this connection
+void applyConnectionOptions(const int socketFeed, const config *cfg) {
+    if (cfg->tcpNoDelay) {
+        set_option(socketFeed, IPPROTO_TCP, TCP_NODELAY, 1, "webserver (TCP_NODELAY)");
+    }
+
+    // Repeated so a reload takes effect without a restart
+    if (cfg->rcvBuf > 0) {
+        set_option(socketFeed, SOL_SOCKET, SO_RCVBUF, cfg->rcvBuf, "webserver (SO_RCVBUF)");
+    }
+    if (cfg->sndBuf > 0) {
+        set_option(socketFeed, SOL_SOCKET, SO_SNDBUF, cfg->sndBuf, "webserver (SO_SNDBUF)");
+    }
+
+    // Spin on the device queue instead of sleeping when reading, trades CPU for latency
+    if (cfg->busyPollUsec > 0) {
+        set_option(socketFeed, SOL_SOCKET, SO_BUSY_POLL, cfg->busyPollUsec, "webserver (SO_BUSY_POLL)");
+    }
+}
+
+// Holds back partial frames while corked so the headers and body of a response leave in as few packets as possible
+void setCork(const int socketFeed, const config *cfg, const bool corked) {
+    if (cfg->tcpCork) {
+        set_option(socketFeed, IPPROTO_TCP, TCP_CORK, corked, "webserver (TCP_CORK)");
+    }
+}
@@ -0,0 +1,11 @@
+#ifndef SOCKET_OPTIONS_H
+#define SOCKET_OPTIONS_H
+
+#include <stdbool.h>
+#include "config.h"
+
+void applyListenerOptions(int socketFeed, const config *cfg, bool inherited);
+void applyConnectionOptions(int socketFeed, const config *cfg);
+void setCork(int socketFeed, const config *cfg, bool corked);
+
+#endif //SOCKET_OPTIONS_H
@@ -0,0 +1,390 @@
+#include "thread_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define INITIAL_DEQUE_SIZE 64
+#define INITIAL_QUEUE_CAPACITY 64
+// Most tasks a worker moves from the injection queue to its deque at once, below INITIAL_DEQUE_SIZE so an
+// empty deque never has to grow to take them
+#define INJECTED_BATCH_SIZE 32
+
+// Defines a struct for the arguments of a worker thread
+typedef struct worker_args {
+    thread_pool *pool;
+    int index;
+} worker_args;
+
+// Index of the worker running on this thread, -1 outside the pool
+static _Thread_local int currentWorker = -1;
+static _Thread_local const thread_pool *currentPool = NULL;
+
+static task_array* create_task_array(const int64_t size, task_array *previous) {
+    task_array *array = malloc(sizeof(task_array));
+
+    if (array == NULL) {
+        return NULL;
+    }
+    array->tasks = calloc(size, sizeof(_Atomic(task *)));
+
+    if (array->tasks == NULL) {
+        free(array);
+        return NULL;
+    }
+    array->size = size;
+    array->previous = previous;
+    return array;
+}
+
+static bool init_deque(task_deque *deque) {
+    task_array *array = create_task_array(INITIAL_DEQUE_SIZE, NULL);
+
+    if (array == NULL) {
+        printf("Error allocating memory for task deque\n");
+        return false;
+    }
+    atomic_init(&deque->top, 0);
+    atomic_init(&deque->bottom, 0);
+    atomic_init(&deque->array, array);
+    return true;
+}
+
+static void free_deque(task_deque *deque) {
+    task_array *array = atomic_load(&deque->array);
+
+    // Tasks left behind were never run, which only happens if the pool failed to start
+    for (int64_t i = atomic_load(&deque->top); i < atomic_load(&deque->bottom); i++) {
+        free(atomic_load(&array->tasks[i & (array->size - 1)]));
+    }
+    while (array != NULL) {
+        task_array *previous = array->previous;
+        free(array->tasks);
+        free(array);
+        array = previous;
+    }
+}
+
+// Doubles the array, only called by the owner
+static task_array* grow_deque(task_deque *deque, task_array *array, const int64_t bottom, const int64_t top) {
+    task_array *bigger = create_task_array(array->size * 2, array);
+
+    if (bigger == NULL) {
+        return NULL;
+    }
+    for (int64_t i = top; i < bottom; i++) {
+        atomic_store_explicit(&bigger->tasks[i & (bigger->size - 1)],
+                              atomic_load_explicit(&array->tasks[i & (array->size - 1)], memory_order_relaxed),
+                              memory_order_relaxed);
+    }
+    atomic_store_explicit(&deque->array, bigger, memory_order_release);
+    return bigger;
+}
+
+// Owner only: pushes at the bottom
+static bool push_bottom(task_deque *deque, task *t) {
+    const int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    const int64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    task_array *array = atomic_load_explicit(&deque->array, memory_order_relaxed);
+
+    if (bottom - top > array->size - 1) {
+        array = grow_deque(deque, array, bottom, top);
+
+        if (array == NULL) {
+            printf("Error growing task deque\n");
+            return false;
+        }
+    }
+    atomic_store_explicit(&array->tasks[bottom & (array->size - 1)], t, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    return true;
+}
+
+// Owner only: takes the newest task, which is the most likely to still be in cache
+static task* take_bottom(task_deque *deque) {
+    const int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    task_array *array = atomic_load_explicit(&deque->array, memory_order_relaxed);
+    atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+    task *t = NULL;
+
+    if (top <= bottom) {
+        t = atomic_load_explicit(&array->tasks[bottom & (array->size - 1)], memory_order_relaxed);
+
+        if (top == bottom) {
+            // Last task, race the thieves for it
+            if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1,
+                                                         memory_order_seq_cst, memory_order_relaxed)) {
+                t = NULL;
+            }
+            atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+        }
+    } else {
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    }
+    return t;
+}
+
+// Any worker: takes the oldest task, away from the owner's end
+// Returns NULL if the deque is empty or another thread won the race
+static task* steal_top(task_deque *deque) {
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    const int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+
+    if (top >= bottom) {
+        return NULL;
+    }
+    task_array *array = atomic_load_explicit(&deque->array, memory_order_acquire);
+    task *t = atomic_load_explicit(&array->tasks[top & (array->size - 1)], memory_order_relaxed);
+
+    if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1,
+                                                 memory_order_seq_cst, memory_order_relaxed)) {
+        return NULL;
+    }
+    return t;
+}
+
+static bool init_queue(task_queue *queue) {
+    queue->tasks = malloc(sizeof(task *) * INITIAL_QUEUE_CAPACITY);
+
+    if (queue->tasks == NULL) {
+        printf("Error allocating memory for task queue\n");
+        return false;
+    }
+    queue->capacity = INITIAL_QUEUE_CAPACITY;
+    queue->head = 0;
+    queue->count = 0;
+    pthread_mutex_init(&queue->lock, NULL);
+    return true;
+}
+
+static bool queue_push(task_queue *queue, task *t) {
+    pthread_mutex_lock(&queue->lock);
+
+    if (queue->count == queue->capacity) {
+        task **tasks = malloc(sizeof(task *) * queue->capacity * 2);
+
+        if (tasks == NULL) {
+            pthread_mutex_unlock(&queue->lock);
+            printf("Error growing task queue\n");
+            return false;
+        }
+        for (int i = 0; i < queue->count; i++) {
+            tasks[i] = queue->tasks[(queue->head + i) % queue->capacity];
+        }
+        free(queue->tasks);
+        queue->tasks = tasks;
+        queue->head = 0;
+        queue->capacity *= 2;
+    }
+    queue->tasks[(queue->head + queue->count) % queue->capacity] = t;
+    queue->count++;
+    pthread_mutex_unlock(&queue->lock);
+    return true;
+}
+
+// Takes the workers' fair share of the queue, at most max tasks, oldest first
+static int queue_pop_batch(task_queue *queue, task **out, const int max, const int workerCount) {
+    pthread_mutex_lock(&queue->lock);
+    int count = queue->count / workerCount + 1;
+    count = count < max ? count : max;
+    count = count < queue->count ? count : queue->count;
+
+    for (int i = 0; i < count; i++) {
+        out[i] = queue->tasks[queue->head];
+        queue->head = (queue->head + 1) % queue->capacity;
+    }
+    queue->count -= count;
+    pthread_mutex_unlock(&queue->lock);
+    return count;
+}
+
+// Moves a batch of submitted tasks onto the worker's own deque, where idle workers can steal them
+// Every task comes from the I/O threads, so without this the deques would always be empty
+// Returns the oldest task of the batch to run right away
+static task* take_injected(thread_pool *pool, const int index) {
+    task *batch[INJECTED_BATCH_SIZE];
+    const int count = queue_pop_batch(&pool->injected, batch, INJECTED_BATCH_SIZE, pool->workerCount);
+
+    // Newest first, so the owner keeps taking them in submission order while thieves take the newest
+    for (int i = count - 1; i > 0; i--) {
+        if (!push_bottom(&pool->deques[index], batch[i]) && !queue_push(&pool->injected, batch[i])) {
+            // Neither can fail short of memory, run the task here rather than lose it
+            atomic_fetch_sub(&pool->pending, 1);
+            batch[i]->function(batch[i]->arg);
+            free(batch[i]);
+        }
+    }
+    return count > 0 ? batch[0] : NULL;
+}
+
+static task* find_task(thread_pool *pool, const int index) {
+    task *t = take_bottom(&pool->deques[index]);
+
+    if (t == NULL) {
+        t = take_injected(pool, index);
+    }
+    for (int i = 1; t == NULL && i < pool->workerCount; i++) {
+        t = steal_top(&pool->deques[(index + i) % pool->workerCount]);
+    }
+    return t;
+}
+
+static void* run_worker(void *arg) {
+    worker_args *args = arg;
+    thread_pool *pool = args->pool;
+    const int index = args->index;
+    free(args);
+    currentWorker = index;
+    currentPool = pool;
+
+    // workerCount is only final once create_thread_pool() lets go of this lock
+    pthread_mutex_lock(&pool->sleepLock);
+    pthread_mutex_unlock(&pool->sleepLock);
+
+    for (;;) {
+        task *t = find_task(pool, index);
+
+        if (t != NULL) {
+            atomic_fetch_sub(&pool->pending, 1);
+            t->function(t->arg);
+            free(t);
+            continue;
+        }
+
+        // Nothing to run or steal, sleep until a task is submitted
+        // A failed steal can leave pending > 0 for a moment, the loop just tries again
+        pthread_mutex_lock(&pool->sleepLock);
+        while (atomic_load(&pool->pending) == 0 && !pool->stopping) {
+            pthread_cond_wait(&pool->wake, &pool->sleepLock);
+        }
+        const bool stopping = pool->stopping && atomic_load(&pool->pending) == 0;
+        pthread_mutex_unlock(&pool->sleepLock);
+
+        if (stopping) {
+            return NULL;
+        }
+    }
+}
+
+// Creates a pool with workerCount threads, one per online CPU if workerCount is 0
+thread_pool* create_thread_pool(int workerCount) {
+    if (workerCount <= 0) {
+        workerCount = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        workerCount = workerCount > 0 ? workerCount : 1;
+    }
+
+    thread_pool *pool = calloc(1, sizeof(thread_pool));
+
+    if (pool == NULL) {
+        printf("Error creating thread pool\n");
+        return NULL;
+    }
+    pool->threads = calloc(workerCount, sizeof(pthread_t));
+    pool->deques = calloc(workerCount, sizeof(task_deque));
+
+    if (pool->threads == NULL || pool->deques == NULL || !init_queue(&pool->injected)) {
+        printf("Error creating thread pool workers\n");
+        free(pool->threads);
+        free(pool->deques);
+        free(pool);
+        return NULL;
+    }
+    atomic_init(&pool->pending, 0);
+    pthread_mutex_init(&pool->sleepLock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+
+    // Every deque exists before the first worker starts stealing from them
+    for (int i = 0; i < workerCount; i++) {
+        if (!init_deque(&pool->deques[i])) {
+            workerCount = i;
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&pool->sleepLock);
+
+    for (int i = 0; i < workerCount; i++) {
+        worker_args *args = malloc(sizeof(worker_args));
+
+        if (args == NULL) {
+            break;
+        }
+        args->pool = pool;
+        args->index = i;
+
+        if (pthread_create(&pool->threads[i], NULL, run_worker, args) != 0) {
+            perror("webserver (pthread_create)");
+            free(args);
+            break;
+        }
+        pool->workerCount++;
+    }
+    pthread_mutex_unlock(&pool->sleepLock);
+
+    // Deques of workers that didn't start
+    for (int i = pool->workerCount; i < workerCount; i++) {
+        free_deque(&pool->deques[i]);
+    }
+
+    if (pool->workerCount == 0) {
+        free_thread_pool(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+bool thread_pool_submit(thread_pool *pool, const task_function function, void *arg) {
+    task *t = malloc(sizeof(task));
+
+    if (t == NULL) {
+        printf("Error allocating memory for task\n");
+        return false;
+    }
+    t->function = function;
+    t->arg = arg;
+
+    // Tasks spawned by a worker stay on its own deque, others go through the injection queue
+    const bool pushed = currentPool == pool
+        ? push_bottom(&pool->deques[currentWorker], t)
+        : queue_push(&pool->injected, t);
+
+    if (!pushed) {
+        free(t);
+        return false;
+    }
+    atomic_fetch_add(&pool->pending, 1);
+
+    pthread_mutex_lock(&pool->sleepLock);
+    pthread_cond_signal(&pool->wake);
+    pthread_mutex_unlock(&pool->sleepLock);
+    return true;
+}
+
+// Runs every queued task, then stops the workers and frees the pool
+void free_thread_pool(thread_pool *pool) {
+    pthread_mutex_lock(&pool->sleepLock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->sleepLock);
+
+    for (int i = 0; i < pool->workerCount; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    for (int i = 0; i < pool->workerCount; i++) {
+        free_deque(&pool->deques[i]);
+    }
+    for (int i = 0; i < pool->injected.count; i++) {
+        free(pool->injected.tasks[(pool->injected.head + i) % pool->injected.capacity]);
+    }
+    pthread_mutex_destroy(&pool->injected.lock);
+    pthread_mutex_destroy(&pool->sleepLock);
+    pthread_cond_destroy(&pool->wake);
+    free(pool->injected.tasks);
+    free(pool->threads);
+    free(pool->deques);
+    free(pool);
+}
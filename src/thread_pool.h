@@ -0,0 +1,58 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef void (*task_function)(void *arg);
+
+// Defines a struct for a unit of work
+typedef struct task {
+    task_function function;
+    void *arg;
+} task;
+
+// Defines a struct for the circular array behind a task_deque
+// Arrays replaced by a bigger one are kept until the pool is freed since thieves may still be reading them
+typedef struct task_array {
+    int64_t size;               // Always a power of two
+    _Atomic(task *) *tasks;
+    struct task_array *previous;
+} task_array;
+
+// Defines a struct for a Chase-Lev work-stealing deque
+// Only the owning worker pushes and takes at the bottom, any worker can steal from the top without a lock
+typedef struct task_deque {
+    atomic_int_least64_t top;
+    atomic_int_least64_t bottom;
+    _Atomic(task_array *) array;
+} task_deque;
+
+// Defines a struct for the queue of tasks submitted from outside the pool
+typedef struct task_queue {
+    task **tasks;
+    int capacity;
+    int head;
+    int count;
+    pthread_mutex_t lock;
+} task_queue;
+
+// Defines a struct for a work-stealing thread pool
+typedef struct thread_pool {
+    int workerCount;
+    pthread_t *threads;
+    task_deque *deques;         // One per worker
+    task_queue injected;        // Tasks submitted by threads outside the pool, e.g. the I/O threads
+    atomic_int pending;         // Tasks queued but not yet taken
+    bool stopping;
+    pthread_mutex_t sleepLock;
+    pthread_cond_t wake;
+} thread_pool;
+
+thread_pool* create_thread_pool(int workerCount);
+bool thread_pool_submit(thread_pool *pool, task_function function, void *arg);
+void free_thread_pool(thread_pool *pool);
+
+#endif //THREAD_POOL_H
@@ -4,9 +4,9 @@
 
 #include "toolbox.h"
 
-hashtable* parseJSON(const char *jsonString) {
+// Parses one object, nested objects are parsed recursively with depth + 1
+static hashtable* parseObject(const char *jsonString, const config *cfg, const int depth) {
     char *cleanedJSON = cleanJSON(jsonString);
-    void *kvpArray[MAX_KVP];
     int index = 0;
     int start = 0;
     int count = 0;
@@ -16,16 +16,35 @@ hashtable* parseJSON(const char *jsonString) {
         printf("Error cleaning JSON\n");
         return NULL;
     }
-    printf("Now parsing JSON : %s\n", cleanedJSON);
 
     // Checks if JSON is malformed
-    if (cleanedJSON[0] != '{' || cleanedJSON[strlen(cleanedJSON) - 1] != '}') {
+    const size_t cleanedLen = strlen(cleanedJSON);
+
+    if (cleanedLen < 2 || cleanedJSON[0] != '{' || cleanedJSON[cleanedLen - 1] != '}') {
         printf("Malformed JSON input : %s\n", cleanedJSON);
+        free(cleanedJSON);
+        return NULL;
+    }
+
+    // Every level allocates a whole table, so deep nesting is refused rather than followed
+    if (depth > MAX_JSON_DEPTH) {
+        printf("Malformed JSON input : nested deeper than %d levels\n", MAX_JSON_DEPTH);
+        free(cleanedJSON);
+        return NULL;
+    }
+
+    void **kvpArray = malloc(cfg->maxKvp * sizeof(void *));
+
+    if (kvpArray == NULL) {
+        printf("Error allocating memory for kvpArray\n");
+        free(cleanedJSON);
         return NULL;
     }
 
     // Iterate over the entire JSON string
-    while (cleanedJSON[index] != '\0' && count < MAX_KVP) {
+    while (cleanedJSON[index] != '\0') {
+        bool split = false;
+
         if (cleanedJSON[index] == '{') {
             nestingLevel++;
             if (nestingLevel == 1) {
@@ -33,55 +52,91 @@ hashtable* parseJSON(const char *jsonString) {
             }
         } else if (cleanedJSON[index] == '}') {
             nestingLevel--;
-            if (nestingLevel == 0) {
-                // End of the current object
-                char *kvp = strndup(cleanedJSON + start, index - start);
-                kvpArray[count++] = kvp;
-                start = index + 1;
-            }
+            split = nestingLevel == 0;    // End of the current object
         } else if (cleanedJSON[index] == ',' && nestingLevel == 1) {
-            // Split on commas only at the top level
-            char *kvp = strndup(cleanedJSON + start, index - start);
-            kvpArray[count++] = kvp;
+            split = true;    // Split on commas only at the top level
+        }
+
+        if (split) {
+            if (count == cfg->maxKvp) {
+                printf("Malformed JSON input : more than %d key-value pairs\n", cfg->maxKvp);
+
+                for (int i = 0; i < count; i++) {
+                    free(kvpArray[i]);
+                }
+                free(kvpArray);
+                free(cleanedJSON);
+                return NULL;
+            }
+            kvpArray[count++] = strndup(cleanedJSON + start, index - start);
             start = index + 1;
         }
         index++;
     }
+    free(cleanedJSON);
 
-    hashtable *table = create_table();
+    // A table is full once it holds size entries, so one slot per pair is enough and small records stay small
+    const int capacity = count < cfg->tableCapacity ? count : cfg->tableCapacity;
+    hashtable *table = create_table(capacity > 0 ? capacity : 1);
+    bool failed = table == NULL;
 
     // Iterate over the kvpArray
     for (int i = 0; i < count; i++) {
         // Finds the string index of the first occurrence of ':'
         // colon is not alloc new memory it points to the first occurence of the ':' in the string
-        const char *colon = strchr(kvpArray[i], ':');
+        const char *colon = kvpArray[i] != NULL && !failed ? strchr(kvpArray[i], ':') : NULL;
         if (colon != NULL) {
             // Copies the string from kvpArray[i] to colon - kvpArray[i] into key
             char *key = strndup(kvpArray[i], colon - (char*)kvpArray[i]);
+            const char *rawValue = colon + 1;
+            const size_t rawLen = strlen(rawValue);
             void *value;
-            const ValueType type = getValueType(colon + 1);   // Determine type directly from JSON
+            const int type = getValueType(rawValue);   // Determine type directly from JSON
 
             if (type == STRING) {
-                // Extract and clean string value
-                value = strndup(colon + 2, strlen(kvpArray[i]) - strlen(key) - 3);
+                // Extract and clean string value, only quoted values lose their first and last character
+                const bool quoted = rawLen >= 2 && rawValue[0] == '"' && rawValue[rawLen - 1] == '"';
+                value = quoted ? strndup(rawValue + 1, rawLen - 2) : strdup(rawValue);
             } else if (type == HASHTABLE) {
                 // Parse nested JSON to create hashtable
-                value = parseJSON(colon + 1);    // Each nested object is a new JSON string
+                value = parseObject(rawValue, cfg, depth + 1);    // Each nested object is a new JSON string
+                failed = value == NULL;    // Nothing else is parsed once this is set
             } else {
                 // Handle other types (INT, FLOAT, BOOL)
-                value = strndup(colon + 1, strlen(kvpArray[i]) - strlen(key) - 1);
+                value = strdup(rawValue);
             }
 
-            if (key != NULL) {
+            // The table owns value from here on
+            if (key != NULL && value != NULL && type >= 0) {
                 hashtable_insert(table, key, value, type);
+            } else if (value != NULL) {
+                type == HASHTABLE ? free_table(value) : free(value);
             }
             free(key);    // Free the key string after it's used
         }
         free(kvpArray[i]);
     }
+    free(kvpArray);
+
+    // A nested object that couldn't be parsed fails the whole document
+    if (failed && table != NULL) {
+        free_table(table);
+        table = NULL;
+    }
     return table;
 }
 
+hashtable* parseJSON(const char *jsonString) {
+    config cfg;
+    getConfig(&cfg);
+    return parseObject(jsonString, &cfg, 0);
+}
+
+// Same as parseJSON() with settings the caller already holds, skips the lock around the global ones
+hashtable* parseJSONWithConfig(const char *jsonString, const config *cfg) {
+    return parseObject(jsonString, cfg, 0);
+}
+
 char* cleanJSON(const char *string) {
     if (string == NULL) return NULL;
     const int length = strlen(string);
@@ -116,34 +171,36 @@ int getValueType(const char* value) {
 
     // Checks if value is NULL
     if (strcmp(lowerValue, "null") == 0) {
+        free(lowerValue);
         return NULL_TYPE;
     }
 
-    // Checks if value is a number by checking if ALL the characters in value are digits or a period
-    if (strspn(value, "0123456789.") == strlen(value)) {
-        // Checks if value is a float
-        if (strchr(value, '.') != NULL) {
-            return FLOAT;
-        }
-        return INT;
+    // Checks if value is a number by checking if the whole value is a valid JSON number
+    ValueType numberType;
+    const size_t valueLen = strlen(value);
+
+    if (valueLen > 0 && scanNumber(value, valueLen, &numberType) == valueLen) {
+        free(lowerValue);
+        return numberType;
     }
 
     // TODO : Handle case where value is capitalized
     // Checks if value is a boolean
     if (strcmp(lowerValue, "true") == 0 || strcmp(lowerValue, "false") == 0) {
+        free(lowerValue);
         return BOOL;
     }
+    free(lowerValue);
 
     // Checks if value is an hashtable
-    if (value[0] == '{' &&  value[strlen(value) - 1] == '}') {
+    if (valueLen >= 2 && value[0] == '{' && value[valueLen - 1] == '}') {
         return HASHTABLE;
     }
-    free(lowerValue);
     return STRING;
 }
 
 void toLowerCase(char *str) {
     for (int i = 0; str[i]; i++) {
-        str[i] = tolower(str[i]);
+        str[i] = tolower((unsigned char)str[i]);
     }
 }
@@ -9,10 +9,13 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include "config.h"
 #include "constants.h"
 #include "my_hashtable.h"
+#include "numparse.h"
 
 hashtable* parseJSON(const char *jsonString);
+hashtable* parseJSONWithConfig(const char *jsonString, const config *cfg);
 char* cleanJSON(const char *jsonString);
 int getValueType(const char *value);
 void toLowerCase(char *str);